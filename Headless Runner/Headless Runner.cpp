@@ -0,0 +1,1011 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include "MyPhysicsEngine.h"
+
+using namespace std;
+using namespace physx;
+
+typedef chrono::high_resolution_clock Clock;
+
+///Command line options of the batch runner
+struct RunOptions
+{
+	PxReal delta_time = 1.f/60.f;
+	PxU32 max_steps = 36000;
+	PxReal max_time = 600.f;
+	bool hammer = true;
+	string json_file = "headless_report.json";
+	PxU32 threads = PhysicsEngine::Scene::AUTO_THREADS;
+	vector<PxU32> affinity_masks;
+	PhysicsEngine::Scene::DispatcherType dispatcher = PhysicsEngine::Scene::DEFAULT_DISPATCHER;
+	PxU32 bench_dispatcher_steps = 0;
+	bool aggregates = true;
+	PxBroadPhaseType::Enum broadphase = PxBroadPhaseType::eMBP;
+	PxU32 regions = 4;
+	string mesh_cache = "mesh_cache";
+	bool bench_startup = false;
+	PxU32 bench_reset_steps = 0;
+	string save_file;
+	string load_file;
+	bool settle = false;
+	string settle_cache = "settle_cache";
+	PhysicsEngine::MyScene::ActivationMode activation = PhysicsEngine::MyScene::ACTIVATION_OFF;
+	PxReal activation_distance = .5f;
+	bool freeze = false;
+	PhysicsEngine::FloorBuilder::FloorType floors = PhysicsEngine::FloorBuilder::FLOOR_MESH;
+	bool bench_floors = false;
+	PhysicsEngine::MyScene::ValidationMode validation = PhysicsEngine::MyScene::VALIDATION_OFF;
+	bool bench_overlaps = false;
+	string course_file;
+	bool generate = false;
+	PhysicsEngine::CourseGeneratorDesc generator;
+	string export_file;
+	bool export_binary = false;
+	PxReal fire_rate = 0.f;
+	bool ccd = false;
+	bool bench_ccd = false;
+	PhysicsEngine::MyScene::MarbleMode marbles = PhysicsEngine::MyScene::MARBLES_RIGID;
+	PxU32 bench_marbles = 0;
+};
+
+///Summary of a single run
+struct RunReport
+{
+	vector<double> step_ms;
+	double total_ms = 0.;
+	double init_ms = 0.;
+	PxReal sim_time = 0.f;
+	bool dominoes_done = false;
+	PxU32 threads = 0;
+	PxU32 dominoes = 0;
+	PxU32 wave_frontier = 0;
+	PxU32 wave_peak = 0;
+	PxU32 activated = 0;
+	PxU32 frozen = 0;
+	PxU32 frozen_statics = 0;
+	PxU32 shapes = 0;
+	PxU32 materials = 0;
+	PxU32 aggregates = 0;
+	PxU32 static_actors = 0;
+	PxU32 static_shapes = 0;
+	PxU32 overlaps = 0;
+	PxU32 overlaps_left = 0;
+	PxU32 overlaps_corrected = 0;
+	PxReal max_penetration = 0.f;
+	//marble volleys fired during the run and the actors in the scene before and after
+	PxU32 volleys = 0;
+	PxU32 projectile_capacity = 0;
+	PxU32 projectiles_peak = 0;
+	PxU32 actors_start = 0;
+	PxU32 actors_end = 0;
+	PhysicsEngine::MeshCacheStats mesh_cache;
+	//broadphase and narrowphase pair totals over the run
+	double broadphase_adds = 0.;
+	double broadphase_removes = 0.;
+	double new_pairs = 0.;
+	double lost_pairs = 0.;
+	double contact_pairs = 0.;
+
+	double Min() const { return step_ms.size() ? *min_element(step_ms.begin(), step_ms.end()) : 0.; }
+	double Max() const { return step_ms.size() ? *max_element(step_ms.begin(), step_ms.end()) : 0.; }
+	double Mean() const { return step_ms.size() ? total_ms / step_ms.size() : 0.; }
+
+	///Mean of the first steps, where the solver pushes penetrating shapes apart
+	double EarlyMean(size_t steps) const
+	{
+		steps = min(steps, step_ms.size());
+		double total = 0.;
+		for (size_t i = 0; i < steps; i++)
+			total += step_ms[i];
+		return steps ? total / steps : 0.;
+	}
+
+	///Percentile of the step times, p in [0,1]
+	double Percentile(double p) const
+	{
+		if (!step_ms.size())
+			return 0.;
+		vector<double> sorted(step_ms);
+		size_t index = min(sorted.size() - 1, (size_t)(p * sorted.size()));
+		nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+		return sorted[index];
+	}
+
+	///Per step average of a total
+	double PerStep(double total) const { return step_ms.size() ? total / step_ms.size() : 0.; }
+
+	///Simulated seconds per wall-clock second spent stepping
+	double RealTimeFactor() const { return total_ms > 0. ? sim_time / (total_ms / 1000.) : 0.; }
+};
+
+void PrintUsage()
+{
+	cout << "Usage: \"Headless Runner\" [options]" << endl;
+	cout << "    --dt <seconds>        simulation step (default 1/60)" << endl;
+	cout << "    --steps <n>           step cap (default 36000)" << endl;
+	cout << "    --time <seconds>      simulated time cap (default 600)" << endl;
+	cout << "    --no-hammer           do not start the domino run" << endl;
+	cout << "    --json <file>         report file (default headless_report.json)" << endl;
+	cout << "    --threads <n|auto>    dispatcher worker threads (default auto)" << endl;
+	cout << "    --affinity <m0,m1..>  hex affinity mask for each worker thread, repeated if short" << endl;
+	cout << "    --dispatcher <default|jobs>  PxDefaultCpuDispatcher or the work-stealing job system" << endl;
+	cout << "    --bench-dispatcher <n>       compare both dispatchers over n steps at 1..N threads" << endl;
+	cout << "    --no-aggregates       add the course segments without aggregates" << endl;
+	cout << "    --broadphase <sap|mbp>  broadphase algorithm (default mbp)" << endl;
+	cout << "    --regions <n>         n x n MBP regions over the course (default 4)" << endl;
+	cout << "    --mesh-cache <dir|off>  cooked mesh directory (default mesh_cache)" << endl;
+	cout << "    --bench-startup       compare scene start-up without and with the mesh cache, with mesh platforms" << endl;
+	cout << "                          (the platforms are the only cooked meshes, a course without raised segments cooks none)" << endl;
+	cout << "    --bench-reset <n>     compare rebuilding and restoring the course after n steps" << endl;
+	cout << "    --save <file>         save the built course as a binary collection" << endl;
+	cout << "    --load <file>         start from a saved course instead of building it" << endl;
+	cout << "    --settle              start with the dominoes asleep at their rest poses" << endl;
+	cout << "    --settle-cache <dir|off>  rest pose directory (default settle_cache)" << endl;
+	cout << "    --activation <off|sleep|kinematic>  park the dominoes ahead of the wave (default off)" << endl;
+	cout << "    --activation-distance <m>  distance from a moving actor at which dominoes wake (default 0.5)" << endl;
+	cout << "    --freeze              merge the toppled dominoes at rest into one static per segment" << endl;
+	cout << "    --floors <boxes|shapes|mesh>  platforms as boxes, one multi-shape static or one mesh per segment (default mesh)" << endl;
+	cout << "    --bench-floors        compare the static actors, shapes and step times of the three floor types" << endl;
+	cout << "    --validate <off|report|correct>  check the spawned dominoes for penetrations, optionally push them out" << endl;
+	cout << "    --bench-overlaps      compare the step times of the course as spawned and with the penetrations corrected" << endl;
+	cout << "    --course <file>       build the course from a text or binary course file" << endl;
+	cout << "    --generate <n>        build a generated course of n dominoes instead" << endl;
+	cout << "    --seed <n>            seed of the generated course (default 1)" << endl;
+	cout << "    --extent <w> <d>      field of the generated course in metres (default 20 20)" << endl;
+	cout << "    --branches <p>        chance of a side branch per generated segment (default 0.1)" << endl;
+	cout << "    --stairs <p>          chance of up and down stairs per generated segment (default 0.2)" << endl;
+	cout << "    --export-course <file>         write the course (--course, --generate or the built-in one) as text and exit" << endl;
+	cout << "    --export-course-binary <file>  write the course in the binary form and exit" << endl;
+	cout << "    --fire <n>            fire n marble volleys per simulated second from above the origin" << endl;
+	cout << "    --ccd                 sweep the marbles with continuous collision detection" << endl;
+	cout << "    --bench-ccd           compare marbles tunnelling through dominoes without CCD, with CCD and with the scene substepped" << endl;
+	cout << "    --marbles <rigid|particles>  fire rigid spheres or particles of a particle system (default rigid)" << endl;
+	cout << "    --bench-marbles <n>   compare the step times of n marbles fired at once as rigid spheres and as particles" << endl;
+}
+
+///Parse a comma separated list of hex masks
+vector<PxU32> ParseMasks(const string& list)
+{
+	vector<PxU32> masks;
+	size_t start = 0;
+	while (start < list.size())
+	{
+		size_t end = list.find(',', start);
+		if (end == string::npos)
+			end = list.size();
+		masks.push_back((PxU32)strtoul(list.substr(start, end - start).c_str(), 0, 16));
+		start = end + 1;
+	}
+	return masks;
+}
+
+bool ParseOptions(int argc, char* argv[], RunOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		bool has_value = (i + 1 < argc);
+
+		if (arg == "--dt" && has_value)
+			options.delta_time = (PxReal)atof(argv[++i]);
+		else if (arg == "--steps" && has_value)
+			options.max_steps = (PxU32)atoi(argv[++i]);
+		else if (arg == "--time" && has_value)
+			options.max_time = (PxReal)atof(argv[++i]);
+		else if (arg == "--no-hammer")
+			options.hammer = false;
+		else if (arg == "--json" && has_value)
+			options.json_file = argv[++i];
+		else if (arg == "--threads" && has_value)
+		{
+			string value = argv[++i];
+			options.threads = (value == "auto") ? PhysicsEngine::Scene::AUTO_THREADS : (PxU32)atoi(value.c_str());
+		}
+		else if (arg == "--affinity" && has_value)
+			options.affinity_masks = ParseMasks(argv[++i]);
+		else if (arg == "--dispatcher" && has_value)
+		{
+			string value = argv[++i];
+			if (value == "jobs")
+				options.dispatcher = PhysicsEngine::Scene::JOB_SYSTEM_DISPATCHER;
+			else if (value == "default")
+				options.dispatcher = PhysicsEngine::Scene::DEFAULT_DISPATCHER;
+			else
+				return false;
+		}
+		else if (arg == "--bench-dispatcher" && has_value)
+			options.bench_dispatcher_steps = (PxU32)atoi(argv[++i]);
+		else if (arg == "--no-aggregates")
+			options.aggregates = false;
+		else if (arg == "--broadphase" && has_value)
+		{
+			string value = argv[++i];
+			if (value == "sap")
+				options.broadphase = PxBroadPhaseType::eSAP;
+			else if (value == "mbp")
+				options.broadphase = PxBroadPhaseType::eMBP;
+			else
+				return false;
+		}
+		else if (arg == "--regions" && has_value)
+			options.regions = (PxU32)atoi(argv[++i]);
+		else if (arg == "--mesh-cache" && has_value)
+		{
+			string value = argv[++i];
+			options.mesh_cache = (value == "off") ? "" : value;
+		}
+		else if (arg == "--bench-startup")
+			options.bench_startup = true;
+		else if (arg == "--bench-reset" && has_value)
+			options.bench_reset_steps = (PxU32)atoi(argv[++i]);
+		else if (arg == "--save" && has_value)
+			options.save_file = argv[++i];
+		else if (arg == "--load" && has_value)
+			options.load_file = argv[++i];
+		else if (arg == "--settle")
+			options.settle = true;
+		else if (arg == "--settle-cache" && has_value)
+		{
+			string value = argv[++i];
+			options.settle_cache = (value == "off") ? "" : value;
+		}
+		else if (arg == "--activation" && has_value)
+		{
+			string value = argv[++i];
+			if (value == "off")
+				options.activation = PhysicsEngine::MyScene::ACTIVATION_OFF;
+			else if (value == "sleep")
+				options.activation = PhysicsEngine::MyScene::ACTIVATION_SLEEP;
+			else if (value == "kinematic")
+				options.activation = PhysicsEngine::MyScene::ACTIVATION_KINEMATIC;
+			else
+				return false;
+		}
+		else if (arg == "--activation-distance" && has_value)
+			options.activation_distance = (PxReal)atof(argv[++i]);
+		else if (arg == "--freeze")
+			options.freeze = true;
+		else if (arg == "--floors" && has_value)
+		{
+			string value = argv[++i];
+			if (value == "boxes")
+				options.floors = PhysicsEngine::FloorBuilder::FLOOR_BOXES;
+			else if (value == "shapes")
+				options.floors = PhysicsEngine::FloorBuilder::FLOOR_SHAPES;
+			else if (value == "mesh")
+				options.floors = PhysicsEngine::FloorBuilder::FLOOR_MESH;
+			else
+				return false;
+		}
+		else if (arg == "--bench-floors")
+			options.bench_floors = true;
+		else if (arg == "--validate" && has_value)
+		{
+			string value = argv[++i];
+			if (value == "off")
+				options.validation = PhysicsEngine::MyScene::VALIDATION_OFF;
+			else if (value == "report")
+				options.validation = PhysicsEngine::MyScene::VALIDATION_REPORT;
+			else if (value == "correct")
+				options.validation = PhysicsEngine::MyScene::VALIDATION_CORRECT;
+			else
+				return false;
+		}
+		else if (arg == "--bench-overlaps")
+			options.bench_overlaps = true;
+		else if (arg == "--course" && has_value)
+			options.course_file = argv[++i];
+		else if (arg == "--generate" && has_value)
+		{
+			options.generate = true;
+			options.generator.dominoes = (PxU32)atoi(argv[++i]);
+		}
+		else if (arg == "--seed" && has_value)
+			options.generator.seed = strtoull(argv[++i], 0, 10);
+		else if (arg == "--extent" && (i + 2 < argc))
+		{
+			options.generator.extent.x = (PxReal)atof(argv[++i]);
+			options.generator.extent.y = (PxReal)atof(argv[++i]);
+		}
+		else if (arg == "--branches" && has_value)
+			options.generator.branch_probability = (PxReal)atof(argv[++i]);
+		else if (arg == "--stairs" && has_value)
+			options.generator.stairs_probability = (PxReal)atof(argv[++i]);
+		else if ((arg == "--export-course" || arg == "--export-course-binary") && has_value)
+		{
+			options.export_file = argv[++i];
+			options.export_binary = (arg == "--export-course-binary");
+		}
+		else if (arg == "--fire" && has_value)
+			options.fire_rate = (PxReal)atof(argv[++i]);
+		else if (arg == "--ccd")
+			options.ccd = true;
+		else if (arg == "--bench-ccd")
+			options.bench_ccd = true;
+		else if (arg == "--marbles" && has_value)
+		{
+			string value = argv[++i];
+			if (value == "rigid")
+				options.marbles = PhysicsEngine::MyScene::MARBLES_RIGID;
+			else if (value == "particles")
+				options.marbles = PhysicsEngine::MyScene::MARBLES_PARTICLES;
+			else
+				return false;
+		}
+		else if (arg == "--bench-marbles" && has_value)
+			options.bench_marbles = (PxU32)atoi(argv[++i]);
+		else
+			return false;
+	}
+	return (options.delta_time > 0.f) && (options.activation_distance > 0.f) && (options.fire_rate >= 0.f);
+}
+
+double Elapsed(const Clock::time_point& start)
+{
+	return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+///Set up a scene from the options shared by the run and the benchmarks: threads, dispatcher, aggregates,
+///broadphase, floors, CCD and the course (the mesh cache is set up once in main)
+void ConfigureScene(const RunOptions& options, PhysicsEngine::MyScene& scene)
+{
+	scene.Threads(options.threads, options.affinity_masks);
+	scene.Dispatcher(options.dispatcher);
+	scene.Aggregates(options.aggregates);
+	scene.BroadPhase(options.broadphase, options.regions);
+	scene.Floors(options.floors);
+	scene.CCD(options.ccd);
+	if (options.generate)
+		scene.Course(options.generator);
+	else
+		scene.Course(options.course_file);
+}
+
+///Build MyScene and step it until the last domino falls or a cap is reached
+RunReport Run(const RunOptions& options)
+{
+	RunReport report;
+
+	Clock::time_point init_start = Clock::now();
+	PhysicsEngine::MyScene* scene = new PhysicsEngine::MyScene();
+	ConfigureScene(options, *scene);
+	scene->SettleCourse(options.settle);
+	scene->Activation(options.activation, options.activation_distance);
+	scene->FreezeDominoes(options.freeze);
+	scene->Validation(options.validation);
+	scene->Marbles(options.marbles);
+	if (options.load_file.size())
+		scene->Load(options.load_file);
+	else
+		scene->Init();
+	report.init_ms = Elapsed(init_start);
+
+	if (options.save_file.size())
+		scene->Save(options.save_file);
+	report.threads = scene->Threads();
+	report.shapes = PhysicsEngine::GetPhysics()->getNbShapes();
+	report.materials = PhysicsEngine::GetPhysics()->getNbMaterials();
+	report.aggregates = scene->Get()->getNbAggregates();
+
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+	vector<PxActor*> statics(scene->Get()->getNbActors(PxActorTypeSelectionFlag::eRIGID_STATIC));
+	if (statics.size())
+		scene->Get()->getActors(PxActorTypeSelectionFlag::eRIGID_STATIC, statics.data(), (PxU32)statics.size());
+#else
+	vector<PxActor*> statics(scene->Get()->getNbActors(PxActorTypeFlag::eRIGID_STATIC));
+	if (statics.size())
+		scene->Get()->getActors(PxActorTypeFlag::eRIGID_STATIC, statics.data(), (PxU32)statics.size());
+#endif
+	report.static_actors = (PxU32)statics.size();
+	for (unsigned int i = 0; i < statics.size(); i++)
+		report.static_shapes += ((PxRigidStatic*)statics[i])->getNbShapes();
+
+	if (options.hammer)
+		scene->HammerPress();
+
+	report.step_ms.reserve(options.max_steps);
+	report.projectile_capacity = scene->ProjectileCapacity();
+	report.actors_start = (PxU32)scene->GetAllActors().size();
+	//volleys come from above and behind the origin
+	PxTransform muzzle(PxVec3(0.f, 1.f, 2.f));
+	PxReal next_volley = 0.f;
+
+	for (PxU32 i = 0; i < options.max_steps && report.sim_time < options.max_time; i++)
+	{
+		if ((options.fire_rate > 0.f) && (report.sim_time >= next_volley))
+		{
+			scene->Fire(muzzle);
+			report.volleys++;
+			next_volley += 1.f / options.fire_rate;
+		}
+
+		Clock::time_point step_start = Clock::now();
+		scene->Update(options.delta_time);
+		double step = Elapsed(step_start);
+
+		report.step_ms.push_back(step);
+		report.total_ms += step;
+		report.sim_time += options.delta_time;
+
+		//simulation statistics are not collected in the release build of the SDK
+		PxSimulationStatistics stats;
+		scene->Get()->getSimulationStatistics(stats);
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+		report.broadphase_adds += stats.getNbBroadPhaseAdds(PxSimulationStatistics::eRIGID_BODY);
+		report.broadphase_removes += stats.getNbBroadPhaseRemoves(PxSimulationStatistics::eRIGID_BODY);
+#else
+		report.broadphase_adds += stats.getNbBroadPhaseAdds();
+		report.broadphase_removes += stats.getNbBroadPhaseRemoves();
+#endif
+		report.new_pairs += stats.nbNewPairs;
+		report.lost_pairs += stats.nbLostPairs;
+		report.contact_pairs += stats.nbDiscreteContactPairsTotal;
+		report.projectiles_peak = PxMax(report.projectiles_peak, scene->ProjectilesFlying());
+
+		if (scene->dominoesDone())
+		{
+			report.dominoes_done = true;
+			break;
+		}
+	}
+
+	//the statics go with the scene
+	report.frozen_statics = scene->FrozenSegments();
+	report.actors_end = (PxU32)scene->GetAllActors().size();
+	scene->Release();
+	report.mesh_cache = PhysicsEngine::GetMeshCacheStats();
+	report.dominoes = scene->Dominoes();
+	report.wave_frontier = scene->WaveFrontier();
+	report.wave_peak = scene->WavePeak();
+	report.activated = scene->ActivatedDominoes();
+	report.frozen = scene->FrozenDominoes();
+	report.overlaps = scene->OverlapsFound();
+	report.overlaps_left = scene->OverlapsLeft();
+	report.overlaps_corrected = scene->OverlapsCorrected();
+	report.max_penetration = scene->MaxPenetration();
+
+	delete scene;
+
+	return report;
+}
+
+void PrintReport(const RunReport& report)
+{
+	cout << fixed << setprecision(3);
+	cout << "worker threads:   " << report.threads << endl;
+	cout << "steps:            " << report.step_ms.size() << endl;
+	cout << "simulated time:   " << report.sim_time << " s" << endl;
+	cout << "dominoes done:    " << (report.dominoes_done ? "yes" : "no") << endl;
+	cout << "wave frontier:    " << report.wave_frontier << "/" << report.dominoes << endl;
+	cout << "peak moving:      " << report.wave_peak << endl;
+	cout << "activated:        " << report.activated << endl;
+	cout << "frozen:           " << report.frozen << " in " << report.frozen_statics << " statics" << endl;
+	cout << "shapes:           " << report.shapes << endl;
+	cout << "materials:        " << report.materials << endl;
+	cout << "aggregates:       " << report.aggregates << endl;
+	cout << "statics:          " << report.static_actors << " actors, " << report.static_shapes << " shapes" << endl;
+	cout << "penetrations:     " << report.overlaps << ", deepest " << report.max_penetration * 1000.f << " mm, "
+		<< report.overlaps_corrected << " moved, " << report.overlaps_left << " left" << endl;
+	cout << "marble volleys:   " << report.volleys << ", " << report.projectiles_peak << "/" << report.projectile_capacity << " in flight at most" << endl;
+	cout << "actors:           " << report.actors_start << " at start, " << report.actors_end << " at end" << endl;
+	cout << "mesh cache:       " << report.mesh_cache.memory_hits << " memory, " << report.mesh_cache.disk_hits << " disk, "
+		<< report.mesh_cache.misses << " cooked" << endl;
+	cout << "bp adds/step:     " << report.PerStep(report.broadphase_adds) << endl;
+	cout << "bp removes/step:  " << report.PerStep(report.broadphase_removes) << endl;
+	cout << "new pairs/step:   " << report.PerStep(report.new_pairs) << endl;
+	cout << "lost pairs/step:  " << report.PerStep(report.lost_pairs) << endl;
+	cout << "contacts/step:    " << report.PerStep(report.contact_pairs) << endl;
+	cout << "init:             " << report.init_ms << " ms" << endl;
+	cout << "step min:         " << report.Min() << " ms" << endl;
+	cout << "step mean:        " << report.Mean() << " ms" << endl;
+	cout << "step p50:         " << report.Percentile(.5) << " ms" << endl;
+	cout << "step p99:         " << report.Percentile(.99) << " ms" << endl;
+	cout << "step max:         " << report.Max() << " ms" << endl;
+	cout << "real-time factor: " << report.RealTimeFactor() << endl;
+}
+
+bool WriteJson(const RunReport& report, const RunOptions& options)
+{
+	ofstream file(options.json_file.c_str());
+	if (!file)
+		return false;
+
+	file << fixed << setprecision(6);
+	file << "{" << endl;
+	file << "  \"delta_time\": " << options.delta_time << "," << endl;
+	file << "  \"threads\": " << report.threads << "," << endl;
+	file << "  \"steps\": " << report.step_ms.size() << "," << endl;
+	file << "  \"simulated_time\": " << report.sim_time << "," << endl;
+	file << "  \"dominoes_done\": " << (report.dominoes_done ? "true" : "false") << "," << endl;
+	file << "  \"dominoes\": " << report.dominoes << "," << endl;
+	file << "  \"wave_frontier\": " << report.wave_frontier << "," << endl;
+	file << "  \"wave_peak\": " << report.wave_peak << "," << endl;
+	file << "  \"activated\": " << report.activated << "," << endl;
+	file << "  \"frozen\": " << report.frozen << "," << endl;
+	file << "  \"frozen_statics\": " << report.frozen_statics << "," << endl;
+	file << "  \"shapes\": " << report.shapes << "," << endl;
+	file << "  \"materials\": " << report.materials << "," << endl;
+	file << "  \"aggregates\": " << report.aggregates << "," << endl;
+	file << "  \"static_actors\": " << report.static_actors << "," << endl;
+	file << "  \"static_shapes\": " << report.static_shapes << "," << endl;
+	file << "  \"penetrations\": { \"found\": " << report.overlaps << ", \"max_depth\": " << report.max_penetration << ", \"moved\": "
+		<< report.overlaps_corrected << ", \"left\": " << report.overlaps_left << " }," << endl;
+	file << "  \"projectiles\": { \"volleys\": " << report.volleys << ", \"capacity\": " << report.projectile_capacity << ", \"peak_flying\": "
+		<< report.projectiles_peak << ", \"actors_start\": " << report.actors_start << ", \"actors_end\": " << report.actors_end << " }," << endl;
+	file << "  \"mesh_cache\": { \"memory_hits\": " << report.mesh_cache.memory_hits << ", \"disk_hits\": " << report.mesh_cache.disk_hits
+		<< ", \"misses\": " << report.mesh_cache.misses << " }," << endl;
+	file << "  \"pairs_per_step\": {" << endl;
+	file << "    \"broadphase_adds\": " << report.PerStep(report.broadphase_adds) << "," << endl;
+	file << "    \"broadphase_removes\": " << report.PerStep(report.broadphase_removes) << "," << endl;
+	file << "    \"new\": " << report.PerStep(report.new_pairs) << "," << endl;
+	file << "    \"lost\": " << report.PerStep(report.lost_pairs) << "," << endl;
+	file << "    \"contacts\": " << report.PerStep(report.contact_pairs) << endl;
+	file << "  }," << endl;
+	file << "  \"init_ms\": " << report.init_ms << "," << endl;
+	file << "  \"step_ms\": {" << endl;
+	file << "    \"min\": " << report.Min() << "," << endl;
+	file << "    \"mean\": " << report.Mean() << "," << endl;
+	file << "    \"first_second_mean\": " << report.EarlyMean((size_t)(1.f / options.delta_time)) << "," << endl;
+	file << "    \"p50\": " << report.Percentile(.5) << "," << endl;
+	file << "    \"p99\": " << report.Percentile(.99) << "," << endl;
+	file << "    \"max\": " << report.Max() << endl;
+	file << "  }," << endl;
+	file << "  \"real_time_factor\": " << report.RealTimeFactor() << endl;
+	file << "}" << endl;
+
+	return true;
+}
+
+///Step the course with both dispatchers at 1..N worker threads
+bool BenchmarkDispatchers(const RunOptions& options)
+{
+	const char* names[] = { "default", "jobs" };
+	PxU32 max_threads = PxMax((PxU32)thread::hardware_concurrency(), (PxU32)1);
+
+	ofstream file(options.json_file.c_str());
+	file << fixed << setprecision(6);
+	file << "[" << endl;
+
+	cout << fixed << setprecision(3);
+	cout << "dispatcher threads  mean ms   p99 ms    real-time factor" << endl;
+
+	for (PxU32 threads = 1; threads <= max_threads; threads++)
+	{
+		for (PxU32 type = 0; type < 2; type++)
+		{
+			RunOptions bench = options;
+			bench.threads = threads;
+			bench.dispatcher = (PhysicsEngine::Scene::DispatcherType)type;
+			bench.max_steps = options.bench_dispatcher_steps;
+
+			RunReport report = Run(bench);
+
+			cout << setw(10) << left << names[type] << " " << setw(7) << threads << " " << setw(9) << report.Mean() << " "
+				<< setw(9) << report.Percentile(.99) << " " << report.RealTimeFactor() << endl;
+
+			file << "  { \"dispatcher\": \"" << names[type] << "\", \"threads\": " << threads
+				<< ", \"mean_ms\": " << report.Mean() << ", \"p99_ms\": " << report.Percentile(.99)
+				<< ", \"real_time_factor\": " << report.RealTimeFactor() << " }"
+				<< ((threads == max_threads && type == 1) ? "" : ",") << endl;
+		}
+	}
+
+	file << "]" << endl;
+	return (bool)file;
+}
+
+///Initialise the course without the mesh cache, from memory, then twice from the cache directory
+///(the first disk run is cold only if the directory starts empty).
+///The platforms are built as triangle meshes whatever --floors says, they are the only meshes the course cooks.
+bool BenchmarkStartup(const RunOptions& options)
+{
+	const char* names[] = { "no cache", "memory", "cold disk", "warm disk" };
+	string directory = options.mesh_cache.size() ? options.mesh_cache : "mesh_cache";
+
+	ofstream file(options.json_file.c_str());
+	file << fixed << setprecision(6);
+	file << "[" << endl;
+
+	cout << fixed << setprecision(3);
+	cout << "cache      init ms   memory  disk  cooked" << endl;
+
+	PhysicsEngine::MeshCacheStats previous;
+	for (int mode = 0; mode < 4; mode++)
+	{
+		//the memory mode reuses the meshes of the previous run
+		if (mode != 1)
+			PhysicsEngine::ReleaseMeshCache();
+		PhysicsEngine::MeshCacheDirectory(mode < 2 ? "" : directory);
+
+		RunOptions bench = options;
+		bench.max_steps = 0;
+		bench.floors = PhysicsEngine::FloorBuilder::FLOOR_MESH;
+		RunReport report = Run(bench);
+
+		PhysicsEngine::MeshCacheStats stats = report.mesh_cache;
+		PxU32 memory = stats.memory_hits - previous.memory_hits;
+		PxU32 disk = stats.disk_hits - previous.disk_hits;
+		PxU32 cooked = stats.misses - previous.misses;
+		previous = stats;
+
+		if ((mode == 0) && !cooked)
+			cerr << "The course cooks no meshes, the start-up times do not depend on the mesh cache" << endl;
+
+		cout << setw(10) << left << names[mode] << " " << setw(9) << report.init_ms << " " << setw(7) << memory << " "
+			<< setw(5) << disk << " " << cooked << endl;
+
+		file << "  { \"cache\": \"" << names[mode] << "\", \"init_ms\": " << report.init_ms << ", \"memory_hits\": " << memory
+			<< ", \"disk_hits\": " << disk << ", \"misses\": " << cooked << " }" << (mode == 3 ? "" : ",") << endl;
+	}
+
+	file << "]" << endl;
+	return (bool)file;
+}
+
+///Build and run the course with each floor type
+bool BenchmarkFloors(const RunOptions& options)
+{
+	const char* names[] = { "boxes", "shapes", "mesh" };
+	const PhysicsEngine::FloorBuilder::FloorType types[] = { PhysicsEngine::FloorBuilder::FLOOR_BOXES,
+		PhysicsEngine::FloorBuilder::FLOOR_SHAPES, PhysicsEngine::FloorBuilder::FLOOR_MESH };
+
+	ofstream file(options.json_file.c_str());
+	file << fixed << setprecision(6);
+	file << "[" << endl;
+
+	cout << fixed << setprecision(3);
+	cout << "floors   statics  shapes  init ms   mean step ms" << endl;
+
+	for (int mode = 0; mode < 3; mode++)
+	{
+		RunOptions bench = options;
+		bench.floors = types[mode];
+		RunReport report = Run(bench);
+		double mean = report.step_ms.size() ? report.total_ms / report.step_ms.size() : 0.;
+
+		cout << setw(8) << left << names[mode] << " " << setw(8) << report.static_actors << " " << setw(7) << report.static_shapes << " "
+			<< setw(9) << report.init_ms << " " << mean << endl;
+
+		file << "  { \"floors\": \"" << names[mode] << "\", \"static_actors\": " << report.static_actors << ", \"static_shapes\": "
+			<< report.static_shapes << ", \"init_ms\": " << report.init_ms << ", \"mean_step_ms\": " << mean << " }" << (mode == 2 ? "" : ",") << endl;
+	}
+
+	file << "]" << endl;
+	return (bool)file;
+}
+
+///Run the course as spawned and with the penetrations pushed out, the solver pays for them in the first steps
+bool BenchmarkOverlaps(const RunOptions& options)
+{
+	const char* names[] = { "report", "correct" };
+	const PhysicsEngine::MyScene::ValidationMode modes[] = { PhysicsEngine::MyScene::VALIDATION_REPORT,
+		PhysicsEngine::MyScene::VALIDATION_CORRECT };
+	size_t first_second = (size_t)(1.f / options.delta_time);
+
+	ofstream file(options.json_file.c_str());
+	file << fixed << setprecision(6);
+	file << "[" << endl;
+
+	cout << fixed << setprecision(3);
+	cout << "mode     found   deepest mm  left    first second ms  mean step ms  max step ms" << endl;
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		RunOptions bench = options;
+		bench.validation = modes[mode];
+		RunReport report = Run(bench);
+
+		cout << setw(8) << left << names[mode] << " " << setw(7) << report.overlaps << " " << setw(11) << report.max_penetration * 1000.f << " "
+			<< setw(7) << report.overlaps_left << " " << setw(16) << report.EarlyMean(first_second) << " " << setw(13) << report.Mean() << " "
+			<< report.Max() << endl;
+
+		file << "  { \"validation\": \"" << names[mode] << "\", \"penetrations\": " << report.overlaps << ", \"max_depth\": "
+			<< report.max_penetration << ", \"left\": " << report.overlaps_left << ", \"first_second_ms\": " << report.EarlyMean(first_second)
+			<< ", \"mean_step_ms\": " << report.Mean() << ", \"max_step_ms\": " << report.Max() << " }" << (mode == 1 ? "" : ",") << endl;
+	}
+
+	file << "]" << endl;
+	return (bool)file;
+}
+
+///Fire a marble sideways through single dominoes of the course at rest and count the marbles that come out on the far side
+///without touching their domino: with discrete contacts, with the marbles swept by CCD and with the whole scene substepped
+bool BenchmarkCCD(const RunOptions& options)
+{
+	struct Mode
+	{
+		const char* name;
+		bool ccd;
+		PxU32 substeps;
+	};
+	const Mode modes[] = { { "discrete", false, 1 }, { "ccd", true, 1 }, { "substep4", false, 4 }, { "substep8", false, 8 } };
+	const int mode_count = sizeof(modes) / sizeof(modes[0]);
+	//the course comes to rest before the shots, which are then followed for a quarter of a second
+	const PxU32 rest_frames = (PxU32)(1.f / options.delta_time);
+	const PxU32 flight_frames = (PxU32)(.25f / options.delta_time) + 1;
+
+	ofstream file(options.json_file.c_str());
+	file << fixed << setprecision(6);
+	file << "[" << endl;
+
+	cout << fixed << setprecision(3);
+	cout << "mode      shots  tunnelled  rate    mean frame ms  max frame ms" << endl;
+
+	for (int mode = 0; mode < mode_count; mode++)
+	{
+		PhysicsEngine::MyScene* scene = new PhysicsEngine::MyScene();
+		ConfigureScene(options, *scene);
+		scene->CCD(modes[mode].ccd);
+		//dominoes pushed out of the ground on the first steps would be counted as hit
+		scene->Validation(PhysicsEngine::MyScene::VALIDATION_CORRECT);
+		scene->Init();
+
+		PxReal dt = options.delta_time / modes[mode].substeps;
+		for (PxU32 i = 0; i < rest_frames * modes[mode].substeps; i++)
+			scene->Update(dt);
+
+		//one marble for each of a set of dominoes spread over the course, fired along the width of the domino
+		PxU32 shots = PxMin(scene->ProjectileCapacity(), scene->Dominoes());
+		vector<PxTransform> targets(shots);
+		vector<PhysicsEngine::Actor*> marbles(shots);
+		for (PxU32 i = 0; i < shots; i++)
+		{
+			PxRigidActor* domino = (PxRigidActor*)scene->DominoActor(i * scene->Dominoes() / shots)->Get();
+			targets[i] = domino->getGlobalPose();
+			PxVec3 side = targets[i].q.getBasisVector0();
+			marbles[i] = scene->FireMarble(PxTransform(targets[i].p - side * .5f), side * PhysicsEngine::MyScene::MARBLE_IMPULSE);
+		}
+
+		vector<double> frame_ms;
+		for (PxU32 i = 0; i < flight_frames; i++)
+		{
+			Clock::time_point frame_start = Clock::now();
+			for (PxU32 j = 0; j < modes[mode].substeps; j++)
+				scene->Update(dt);
+			frame_ms.push_back(Elapsed(frame_start));
+		}
+
+		PxU32 tunnelled = 0;
+		for (PxU32 i = 0; i < shots; i++)
+		{
+			PxRigidActor* domino = (PxRigidActor*)scene->DominoActor(i * scene->Dominoes() / shots)->Get();
+			PxVec3 side = targets[i].q.getBasisVector0();
+			PxVec3 marble = ((PxRigidActor*)marbles[i]->Get())->getGlobalPose().p;
+			bool passed = (marble - targets[i].p).dot(side) > PhysicsEngine::domino_size.x;
+			bool untouched = (domino->getGlobalPose().p - targets[i].p).magnitude() < 1e-4f;
+			if (passed && untouched)
+				tunnelled++;
+		}
+
+		scene->Release();
+		delete scene;
+
+		double mean = 0., max = 0.;
+		for (unsigned int i = 0; i < frame_ms.size(); i++)
+		{
+			mean += frame_ms[i];
+			max = PxMax(max, frame_ms[i]);
+		}
+		mean /= frame_ms.size();
+		double rate = shots ? (double)tunnelled / shots : 0.;
+
+		cout << setw(9) << left << modes[mode].name << " " << setw(6) << shots << " " << setw(10) << tunnelled << " " << setw(7) << rate << " "
+			<< setw(14) << mean << " " << max << endl;
+
+		file << "  { \"mode\": \"" << modes[mode].name << "\", \"substeps\": " << modes[mode].substeps << ", \"shots\": " << shots
+			<< ", \"tunnelled\": " << tunnelled << ", \"tunnelling_rate\": " << rate << ", \"mean_frame_ms\": " << mean
+			<< ", \"max_frame_ms\": " << max << " }" << (mode == mode_count - 1 ? "" : ",") << endl;
+	}
+
+	file << "]" << endl;
+	return (bool)file;
+}
+
+///Fire n marbles at once straight down on the start of the course at rest, as rigid spheres and as particles,
+///and compare the step times while they land and how many dominoes they knock over
+bool BenchmarkMarbles(const RunOptions& options)
+{
+	const PhysicsEngine::MyScene::MarbleMode modes[] = { PhysicsEngine::MyScene::MARBLES_RIGID, PhysicsEngine::MyScene::MARBLES_PARTICLES };
+	const char* names[] = { "rigid", "particles" };
+	//the course comes to rest before the volley, which is then followed for a second
+	const PxU32 rest_frames = (PxU32)(1.f / options.delta_time);
+	const PxU32 flight_frames = rest_frames;
+
+	ofstream file(options.json_file.c_str());
+	file << fixed << setprecision(6);
+	file << "[" << endl;
+
+	cout << fixed << setprecision(3);
+	cout << "mode       marbles  fired  dominoes hit  mean step ms  max step ms" << endl;
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		PhysicsEngine::MyScene* scene = new PhysicsEngine::MyScene();
+		ConfigureScene(options, *scene);
+		//dominoes pushed out of the ground on the first steps would be counted as hit
+		scene->Validation(PhysicsEngine::MyScene::VALIDATION_CORRECT);
+		if (modes[mode] == PhysicsEngine::MyScene::MARBLES_RIGID)
+		{
+			PhysicsEngine::ProjectilePoolDesc pool;
+			pool.capacity = options.bench_marbles;
+			scene->Projectiles(pool);
+		}
+		else
+		{
+			PhysicsEngine::MarbleParticlesDesc particles;
+			particles.capacity = options.bench_marbles;
+			scene->Particles(particles);
+		}
+		scene->Marbles(modes[mode]);
+		scene->Init();
+
+		for (PxU32 i = 0; i < rest_frames; i++)
+			scene->Update(options.delta_time);
+
+		vector<PxVec3> rest(scene->Dominoes());
+		for (PxU32 i = 0; i < rest.size(); i++)
+			rest[i] = ((PxRigidActor*)scene->DominoActor(i)->Get())->getGlobalPose().p;
+
+		//from half a metre above the first domino, the square of marbles covers the start of the course
+		PxTransform muzzle(rest[0] + PxVec3(0.f, .5f, 0.f), PxQuat(-PxHalfPi, PxVec3(1.f, 0.f, 0.f)));
+		PxU32 fired = scene->FireVolley(muzzle, options.bench_marbles);
+
+		vector<double> step_ms;
+		for (PxU32 i = 0; i < flight_frames; i++)
+		{
+			Clock::time_point step_start = Clock::now();
+			scene->Update(options.delta_time);
+			step_ms.push_back(Elapsed(step_start));
+		}
+
+		PxU32 hit = 0;
+		for (PxU32 i = 0; i < rest.size(); i++)
+		{
+			if ((((PxRigidActor*)scene->DominoActor(i)->Get())->getGlobalPose().p - rest[i]).magnitude() > PhysicsEngine::domino_size.z)
+				hit++;
+		}
+
+		scene->Release();
+		delete scene;
+
+		double mean = 0., max = 0.;
+		for (unsigned int i = 0; i < step_ms.size(); i++)
+		{
+			mean += step_ms[i];
+			max = PxMax(max, step_ms[i]);
+		}
+		mean /= step_ms.size();
+
+		cout << setw(10) << left << names[mode] << " " << setw(8) << options.bench_marbles << " " << setw(6) << fired << " "
+			<< setw(13) << hit << " " << setw(13) << mean << " " << max << endl;
+
+		file << "  { \"mode\": \"" << names[mode] << "\", \"marbles\": " << options.bench_marbles << ", \"fired\": " << fired
+			<< ", \"dominoes_hit\": " << hit << ", \"mean_step_ms\": " << mean << ", \"max_step_ms\": " << max << " }"
+			<< (mode == 1 ? "" : ",") << endl;
+	}
+
+	file << "]" << endl;
+	return (bool)file;
+}
+
+///Time Scene::Rebuild against the snapshot based Scene::Reset, both after running the course for a while
+bool BenchmarkReset(const RunOptions& options)
+{
+	PhysicsEngine::MyScene* scene = new PhysicsEngine::MyScene();
+	ConfigureScene(options, *scene);
+	scene->Init();
+
+	const int rounds = 5;
+	double rebuild_ms = 0., restore_ms = 0.;
+
+	for (int round = 0; round < rounds; round++)
+	{
+		for (int mode = 0; mode < 2; mode++)
+		{
+			if (options.hammer)
+				scene->HammerPress();
+			for (PxU32 i = 0; i < options.bench_reset_steps; i++)
+				scene->Update(options.delta_time);
+
+			Clock::time_point start = Clock::now();
+			if (mode == 0)
+				scene->Rebuild();
+			else
+				scene->Reset();
+			(mode == 0 ? rebuild_ms : restore_ms) += Elapsed(start);
+		}
+	}
+
+	PxU32 dominoes = scene->Dominoes();
+	scene->Release();
+	delete scene;
+
+	rebuild_ms /= rounds;
+	restore_ms /= rounds;
+
+	cout << fixed << setprecision(3);
+	cout << "dominoes:         " << dominoes << endl;
+	cout << "rebuild:          " << rebuild_ms << " ms" << endl;
+	cout << "snapshot reset:   " << restore_ms << " ms" << endl;
+	cout << "speed-up:         " << (restore_ms > 0. ? rebuild_ms / restore_ms : 0.) << endl;
+
+	ofstream file(options.json_file.c_str());
+	file << fixed << setprecision(6);
+	file << "{ \"steps\": " << options.bench_reset_steps << ", \"dominoes\": " << dominoes
+		<< ", \"rebuild_ms\": " << rebuild_ms << ", \"reset_ms\": " << restore_ms << " }" << endl;
+	return (bool)file;
+}
+
+int main(int argc, char* argv[])
+{
+	RunOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	RunReport report;
+
+	try
+	{
+		PhysicsEngine::PxInit();
+		PhysicsEngine::MeshCacheDirectory(options.mesh_cache);
+		PhysicsEngine::SettleCacheDirectory(options.settle_cache);
+
+		if (options.export_file.size())
+		{
+			PhysicsEngine::CourseReader* course = PhysicsEngine::MyScene::CreateCourse(options.course_file,
+				options.generate ? &options.generator : 0);
+			PhysicsEngine::WriteCourse(options.export_file, *course, options.export_binary);
+			delete course;
+			PhysicsEngine::PxRelease();
+			return 0;
+		}
+
+		if (options.bench_startup || options.bench_reset_steps || options.bench_floors || options.bench_overlaps || options.bench_ccd ||
+			options.bench_marbles)
+		{
+			bool written = options.bench_startup ? BenchmarkStartup(options) :
+				(options.bench_floors ? BenchmarkFloors(options) :
+				(options.bench_overlaps ? BenchmarkOverlaps(options) :
+				(options.bench_ccd ? BenchmarkCCD(options) :
+				(options.bench_marbles ? BenchmarkMarbles(options) : BenchmarkReset(options)))));
+			PhysicsEngine::PxRelease();
+			if (!written)
+				cerr << "Could not write " << options.json_file << endl;
+			return 0;
+		}
+
+		if (options.bench_dispatcher_steps)
+		{
+			bool written = BenchmarkDispatchers(options);
+			PhysicsEngine::PxRelease();
+			if (!written)
+				cerr << "Could not write " << options.json_file << endl;
+			return 0;
+		}
+
+		report = Run(options);
+	}
+	catch (Exception* exc)
+	{
+		cerr << exc->what() << endl;
+		delete exc;
+		return 1;
+	}
+
+	PrintReport(report);
+	if (!WriteJson(report, options))
+		cerr << "Could not write " << options.json_file << endl;
+
+	PhysicsEngine::PxRelease();
+
+	return 0;
+}
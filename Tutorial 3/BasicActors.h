@@ -1,6 +1,7 @@
 #pragma once
 
 #include "PhysicsEngine.h"
+#include "MeshCache.h"
 #include <iostream>
 #include <iomanip>
 
@@ -102,17 +103,10 @@ namespace PhysicsEngine
 			CreateShape(PxConvexMeshGeometry(CookMesh(mesh_desc)), density);
 		}
 
-		//mesh cooking (preparation)
+		//mesh cooking (preparation), cached by the mesh data
 		PxConvexMesh* CookMesh(const PxConvexMeshDesc& mesh_desc)
 		{
-			PxDefaultMemoryOutputStream stream;
-
-			if(!GetCooking()->cookConvexMesh(mesh_desc, stream))
-				throw new Exception("ConvexMesh::CookMesh, cooking failed.");
-
-			PxDefaultMemoryInputData input(stream.getData(), stream.getSize());
-
-			return GetPhysics()->createConvexMesh(input);
+			return CookConvexMesh(mesh_desc);
 		}
 	};
 
@@ -135,17 +129,58 @@ namespace PhysicsEngine
 			CreateShape(PxTriangleMeshGeometry(CookMesh(mesh_desc)));
 		}
 
-		//mesh cooking (preparation)
+		//mesh cooking (preparation), cached by the mesh data
 		PxTriangleMesh* CookMesh(const PxTriangleMeshDesc& mesh_desc)
 		{
-			PxDefaultMemoryOutputStream stream;
+			return CookTriangleMesh(mesh_desc);
+		}
+	};
 
-			if(!GetCooking()->cookTriangleMesh(mesh_desc, stream))
-				throw new Exception("TriangleMesh::CookMesh, cooking failed.");
+	///The HeightField class: static terrain from a grid of heights
+	class HeightField : public StaticActor
+	{
+	public:
+		//heights: rows x columns samples in row order, rows run along x and columns along z
+		//spacing: distance between the rows (x) and between the columns (y)
+		HeightField(const std::vector<PxReal>& heights, PxU32 rows, PxU32 columns, PxVec2 spacing=PxVec2(1.f,1.f), const PxTransform& pose=PxTransform(PxIdentity))
+			: StaticActor(pose)
+		{
+			if ((rows < 2) || (columns < 2) || (heights.size() != rows * columns))
+				throw new Exception("HeightField::HeightField, the heights do not match the grid.");
+
+			//heights are stored as 16-bit integers, the scale spreads them over the full range
+			PxReal max_height = 0.f;
+			for (unsigned int i = 0; i < heights.size(); i++)
+				max_height = PxMax(max_height, PxAbs(heights[i]));
+			PxReal height_scale = (max_height > 0.f) ? max_height / 32767.f : 1.f;
 
-			PxDefaultMemoryInputData input(stream.getData(), stream.getSize());
+			std::vector<PxHeightFieldSample> samples(heights.size());
+			for (unsigned int i = 0; i < heights.size(); i++)
+			{
+				samples[i].height = (PxI16)PxClamp(heights[i] / height_scale + (heights[i] < 0.f ? -.5f : .5f), -32767.f, 32767.f);
+				samples[i].materialIndex0 = 0;
+				samples[i].materialIndex1 = 0;
+				samples[i].setTessFlag();
+			}
 
-			return GetPhysics()->createTriangleMesh(input);
+			PxHeightFieldDesc field_desc;
+			field_desc.format = PxHeightFieldFormat::eS16_TM;
+			field_desc.nbRows = rows;
+			field_desc.nbColumns = columns;
+			field_desc.samples.data = samples.data();
+			field_desc.samples.stride = sizeof(PxHeightFieldSample);
+
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			PxHeightField* field = GetPhysics()->createHeightField(field_desc);
+#else
+			PxHeightField* field = GetCooking()->createHeightField(field_desc, GetPhysics()->getPhysicsInsertionCallback());
+#endif
+			if (!field)
+				throw new Exception("HeightField::HeightField, could not create the heightfield.");
+
+			CreateShape(PxHeightFieldGeometry(field, PxMeshGeometryFlags(), height_scale, spacing.x, spacing.y));
+			//the shape keeps its own reference
+			field->release();
 		}
 	};
 
@@ -204,6 +239,9 @@ namespace PhysicsEngine
 			((PxRevoluteJoint*)joint)->setConstraintFlag(PxConstraintFlag::eDRIVE_LIMITS_ARE_FORCES, 6);
 		}
 
+		///Wrap an existing joint
+		RevoluteJoint(PxRevoluteJoint* existing) : Joint(existing) {}
+
 		void DriveVelocity(PxReal value)
 		{
 			//wake up the attached actors
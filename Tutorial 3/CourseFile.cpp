@@ -0,0 +1,295 @@
+#include "CourseFile.h"
+#include "Exception.h"
+#include <sstream>
+#include <cstring>
+#include <cstddef>
+
+namespace PhysicsEngine
+{
+	using namespace std;
+
+	static const char course_file_magic[8] = { 'P', 'X', 'C', 'O', 'U', 'R', 'S', 'E' };
+	static const PxU32 course_file_version = 1;
+	static const char* segment_names[SEGMENT_TYPES] = { "line", "corner", "stairs_up", "stairs_down", "height", "branch" };
+
+	///Fixed part of a binary course
+	struct CourseFileHeader
+	{
+		char magic[8];
+		PxU32 version;
+		PxU32 materials;
+		PxU32 colors;
+		PxU32 segments;
+		PxTransform start;
+	};
+
+	const char* CourseSegmentName(PxU32 type)
+	{
+		return (type < SEGMENT_TYPES) ? segment_names[type] : "unknown";
+	}
+
+	//a course may only refer to its own materials and colours, every segment but a height change has dominoes
+	static void CheckSegment(const CourseInfo& info, const CourseSegment& segment, const char* method)
+	{
+		if (segment.type >= SEGMENT_TYPES)
+			throw new Exception(string(method) + ", unknown segment type.");
+		//a negative count read into the unsigned field wraps around
+		if ((segment.type != SEGMENT_HEIGHT) && ((PxI32)segment.dominoes <= 0))
+			throw new Exception(string(method) + ", the segment has no dominoes.");
+		if ((segment.type != SEGMENT_HEIGHT) && ((segment.material >= info.materials.size()) || (segment.color >= info.colors.size())))
+			throw new Exception(string(method) + ", the segment refers to a missing material or colour.");
+	}
+
+	bool ArrayCourseReader::Next(CourseSegment& segment)
+	{
+		if (next >= count)
+			return false;
+
+		segment = segments[next++];
+		CheckSegment(info, segment, "ArrayCourseReader::Next");
+		return true;
+	}
+
+	TextCourseReader::TextCourseReader(const string& file_name)
+		: file(file_name.c_str()), has_pending(false), line_number(0)
+	{
+		if (!file)
+			throw new Exception("TextCourseReader::TextCourseReader, could not open the file.");
+
+		//the header ends with the first segment
+		has_pending = ReadSegment(pending);
+
+		if (info.materials.empty())
+			info.materials.push_back(CourseMaterial{ .2f, .2f, .6f });
+		if (info.colors.empty())
+			info.colors.push_back(PxVec3(1.f, 1.f, 1.f));
+
+		if (has_pending)
+			CheckSegment(info, pending, "TextCourseReader::TextCourseReader");
+	}
+
+	bool TextCourseReader::ReadSegment(CourseSegment& segment)
+	{
+		string line;
+		while (getline(file, line))
+		{
+			line_number++;
+			line = line.substr(0, line.find('#'));
+
+			istringstream words(line);
+			string keyword;
+			if (!(words >> keyword))
+				continue;
+
+			bool valid = true;
+			if (keyword == "start")
+			{
+				PxVec3 position;
+				PxReal yaw = 0.f;
+				valid = (bool)(words >> position.x >> position.y >> position.z);
+				words >> yaw;
+				info.start = PxTransform(position, PxQuat(yaw, PxVec3(0.f, 1.f, 0.f)));
+			}
+			else if (keyword == "material")
+			{
+				CourseMaterial material;
+				valid = (bool)(words >> material.static_friction >> material.dynamic_friction >> material.restitution);
+				info.materials.push_back(material);
+			}
+			else if (keyword == "color")
+			{
+				PxVec3 color;
+				valid = (bool)(words >> color.x >> color.y >> color.z);
+				info.colors.push_back(color);
+			}
+			else
+			{
+				PxU32 type = 0;
+				while ((type < SEGMENT_TYPES) && (keyword != segment_names[type]))
+					type++;
+				if (type == SEGMENT_TYPES)
+					valid = false;
+				else if (type == SEGMENT_HEIGHT)
+				{
+					segment = CourseSegment(type);
+					valid = (bool)(words >> segment.value);
+				}
+				else
+				{
+					segment = CourseSegment(type);
+					valid = (bool)(words >> segment.dominoes) && (segment.dominoes > 0);
+					//optional fields
+					if (valid && (words >> segment.value))
+						if (words >> segment.material)
+							words >> segment.color;
+				}
+
+				if (valid)
+					return true;
+			}
+
+			if (!valid)
+			{
+				ostringstream message;
+				message << "TextCourseReader, syntax error in line " << line_number << ".";
+				throw new Exception(message.str());
+			}
+		}
+
+		return false;
+	}
+
+	bool TextCourseReader::Next(CourseSegment& segment)
+	{
+		if (has_pending)
+		{
+			segment = pending;
+			has_pending = false;
+			return true;
+		}
+
+		if (!ReadSegment(segment))
+			return false;
+
+		CheckSegment(info, segment, "TextCourseReader::Next");
+		return true;
+	}
+
+	BinaryCourseReader::BinaryCourseReader(const string& file_name)
+		: file(file_name.c_str(), ios::binary), remaining(0), block_next(0)
+	{
+		CourseFileHeader header;
+		if (!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, course_file_magic, sizeof(header.magic)) ||
+			(header.version != course_file_version))
+			throw new Exception("BinaryCourseReader::BinaryCourseReader, not a course file.");
+
+		info.start = header.start;
+		info.materials.resize(header.materials);
+		info.colors.resize(header.colors);
+		if (header.materials)
+			file.read((char*)info.materials.data(), header.materials * sizeof(CourseMaterial));
+		if (header.colors)
+			file.read((char*)info.colors.data(), header.colors * sizeof(PxVec3));
+		if (!file)
+			throw new Exception("BinaryCourseReader::BinaryCourseReader, the file is truncated.");
+
+		remaining = header.segments;
+	}
+
+	bool BinaryCourseReader::Next(CourseSegment& segment)
+	{
+		if (block_next >= block.size())
+		{
+			if (!remaining)
+				return false;
+
+			//only a block of segments is held at a time
+			block.resize(PxMin(remaining, BLOCK_SIZE));
+			if (!file.read((char*)block.data(), block.size() * sizeof(CourseSegment)))
+				throw new Exception("BinaryCourseReader::Next, the file is truncated.");
+			remaining -= (PxU32)block.size();
+			block_next = 0;
+		}
+
+		segment = block[block_next++];
+		CheckSegment(info, segment, "BinaryCourseReader::Next");
+		return true;
+	}
+
+	CourseReader* OpenCourse(const string& file_name)
+	{
+		ifstream file(file_name.c_str(), ios::binary);
+		if (!file)
+			throw new Exception("PhysicsEngine::OpenCourse, could not open the file.");
+
+		char magic[sizeof(course_file_magic)] = { 0 };
+		file.read(magic, sizeof(magic));
+		file.close();
+
+		if (!memcmp(magic, course_file_magic, sizeof(magic)))
+			return new BinaryCourseReader(file_name);
+		else
+			return new TextCourseReader(file_name);
+	}
+
+	CourseWriter::CourseWriter(const string& file_name, const CourseInfo& info, bool _binary)
+		: file(file_name.c_str(), _binary ? ios::binary : ios::out), binary(_binary), count(0)
+	{
+		if (!file)
+			throw new Exception("CourseWriter::CourseWriter, could not create the file.");
+
+		if (binary)
+		{
+			//the segment count is filled in by Close
+			CourseFileHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, course_file_magic, sizeof(header.magic));
+			header.version = course_file_version;
+			header.materials = (PxU32)info.materials.size();
+			header.colors = (PxU32)info.colors.size();
+			header.start = info.start;
+
+			file.write((const char*)&header, sizeof(header));
+			if (info.materials.size())
+				file.write((const char*)info.materials.data(), info.materials.size() * sizeof(CourseMaterial));
+			if (info.colors.size())
+				file.write((const char*)info.colors.data(), info.colors.size() * sizeof(PxVec3));
+		}
+		else
+		{
+			//the text form keeps the yaw of the start pose only
+			file.precision(9);
+			PxVec3 forward = info.start.q.getBasisVector2();
+			file << "# domino course" << endl;
+			file << "start " << info.start.p.x << " " << info.start.p.y << " " << info.start.p.z << " " << PxAtan2(forward.x, forward.z) << endl;
+			for (unsigned int i = 0; i < info.materials.size(); i++)
+				file << "material " << info.materials[i].static_friction << " " << info.materials[i].dynamic_friction << " "
+					<< info.materials[i].restitution << endl;
+			for (unsigned int i = 0; i < info.colors.size(); i++)
+				file << "color " << info.colors[i].x << " " << info.colors[i].y << " " << info.colors[i].z << endl;
+		}
+	}
+
+	CourseWriter::~CourseWriter()
+	{
+		if (file.is_open())
+			file.close();
+	}
+
+	void CourseWriter::Write(const CourseSegment& segment)
+	{
+		count++;
+
+		if (binary)
+			file.write((const char*)&segment, sizeof(segment));
+		else if (segment.type == SEGMENT_HEIGHT)
+			file << CourseSegmentName(segment.type) << " " << segment.value << endl;
+		else
+			file << CourseSegmentName(segment.type) << " " << segment.dominoes << " " << segment.value << " " << segment.material << " "
+				<< segment.color << endl;
+	}
+
+	void CourseWriter::Close()
+	{
+		if (binary)
+		{
+			file.seekp(offsetof(CourseFileHeader, segments));
+			file.write((const char*)&count, sizeof(count));
+		}
+
+		if (!file)
+			throw new Exception("CourseWriter::Close, could not write the file.");
+		file.close();
+	}
+
+	void WriteCourse(const string& file_name, CourseReader& reader, bool binary)
+	{
+		CourseWriter writer(file_name, reader.Info(), binary);
+
+		CourseSegment segment;
+		while (reader.Next(segment))
+			writer.Write(segment);
+
+		writer.Close();
+	}
+}
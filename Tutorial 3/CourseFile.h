@@ -0,0 +1,170 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+#include <string>
+#include <vector>
+#include <fstream>
+
+namespace PhysicsEngine
+{
+	using namespace physx;
+
+	///Kinds of course segments
+	enum CourseSegmentType
+	{
+		//straight line, value: platform shrink factor
+		SEGMENT_LINE,
+		//curve, value: turn angle in radians
+		SEGMENT_CORNER,
+		//line climbing on platforms
+		SEGMENT_STAIRS_UP,
+		//line descending on platforms
+		SEGMENT_STAIRS_DOWN,
+		//no dominoes, value: height of the next segment
+		SEGMENT_HEIGHT,
+		//side branch: a corner of value radians and a line, both of dominoes.
+		//The branch starts beside the main line, which moves over to the other side.
+		SEGMENT_BRANCH,
+		SEGMENT_TYPES
+	};
+
+	///Layout of the segments: distance between dominoes, rise of a stair and side offset of a branch
+	constexpr PxReal COURSE_SPACING = .0616f;
+	constexpr PxReal COURSE_RISE = .0116f;
+	constexpr PxReal COURSE_BRANCH_OFFSET = .028f;
+
+	///A single segment of a course
+	struct CourseSegment
+	{
+		PxU32 type;
+		PxU32 dominoes;
+		PxReal value;
+		//indices into the materials and colours of the course
+		PxU32 material;
+		PxU32 color;
+
+		CourseSegment(PxU32 _type=SEGMENT_LINE, PxU32 _dominoes=0, PxReal _value=0.f, PxU32 _material=0, PxU32 _color=0)
+			: type(_type), dominoes(_dominoes), value(_value), material(_material), color(_color) {}
+	};
+
+	///Domino material of a course
+	struct CourseMaterial
+	{
+		PxReal static_friction;
+		PxReal dynamic_friction;
+		PxReal restitution;
+	};
+
+	///Everything about a course that comes before its segments
+	struct CourseInfo
+	{
+		PxTransform start;
+		std::vector<CourseMaterial> materials;
+		std::vector<PxVec3> colors;
+
+		CourseInfo() : start(PxIdentity) {}
+	};
+
+	///Name of a segment type in the text format
+	const char* CourseSegmentName(PxU32 type);
+
+	///Streaming source of course segments
+	class CourseReader
+	{
+	public:
+		virtual ~CourseReader() {}
+
+		///Start pose, materials and colours
+		virtual const CourseInfo& Info() = 0;
+
+		///Read the next segment, false at the end of the course
+		virtual bool Next(CourseSegment& segment) = 0;
+	};
+
+	///Course held in memory, e.g. a built-in layout
+	class ArrayCourseReader : public CourseReader
+	{
+		CourseInfo info;
+		const CourseSegment* segments;
+		PxU32 count;
+		PxU32 next;
+
+	public:
+		ArrayCourseReader(const CourseInfo& _info, const CourseSegment* _segments, PxU32 _count)
+			: info(_info), segments(_segments), count(_count), next(0) {}
+
+		virtual const CourseInfo& Info() { return info; }
+
+		virtual bool Next(CourseSegment& segment);
+	};
+
+	///Text course, one statement per line:
+	///  start <x> <y> <z> <yaw>
+	///  material <static friction> <dynamic friction> <restitution>
+	///  color <r> <g> <b>
+	///  <line|corner|stairs_up|stairs_down|branch> <dominoes> [value] [material] [color]
+	///  height <y>
+	///The start, materials and colours have to come before the first segment, # starts a comment.
+	class TextCourseReader : public CourseReader
+	{
+		std::ifstream file;
+		CourseInfo info;
+		//first segment, read while looking for the end of the header
+		CourseSegment pending;
+		bool has_pending;
+		PxU32 line_number;
+
+		//read up to the next segment, false at the end of the file
+		bool ReadSegment(CourseSegment& segment);
+
+	public:
+		TextCourseReader(const std::string& file_name);
+
+		virtual const CourseInfo& Info() { return info; }
+
+		virtual bool Next(CourseSegment& segment);
+	};
+
+	///Binary course: a header, the materials and colours, then fixed size segment records read in blocks
+	class BinaryCourseReader : public CourseReader
+	{
+		std::ifstream file;
+		CourseInfo info;
+		PxU32 remaining;
+		std::vector<CourseSegment> block;
+		PxU32 block_next;
+
+	public:
+		static const PxU32 BLOCK_SIZE = 4096;
+
+		BinaryCourseReader(const std::string& file_name);
+
+		virtual const CourseInfo& Info() { return info; }
+
+		virtual bool Next(CourseSegment& segment);
+	};
+
+	///Open a text or binary course file, throws if it cannot be read
+	CourseReader* OpenCourse(const std::string& file_name);
+
+	///Write a course segment by segment, in the text or the binary form
+	class CourseWriter
+	{
+		std::ofstream file;
+		bool binary;
+		PxU32 count;
+
+	public:
+		CourseWriter(const std::string& file_name, const CourseInfo& info, bool binary);
+
+		~CourseWriter();
+
+		void Write(const CourseSegment& segment);
+
+		///Finish the file, throws if it could not be written
+		void Close();
+	};
+
+	///Copy a course from a reader into a file
+	void WriteCourse(const std::string& file_name, CourseReader& reader, bool binary);
+}
@@ -0,0 +1,301 @@
+#include "CourseGenerator.h"
+#include "Exception.h"
+
+namespace PhysicsEngine
+{
+	using namespace std;
+
+	//size of the footprint cells, about a domino
+	static constexpr PxReal cell_size = .1f;
+	//shortest line worth laying before a U-turn
+	static const PxU32 min_line = 20;
+
+	//a quarter of a right U-turn, laid out at compile time
+	static constexpr SegmentTable<CornerKind, CourseGenerator::TURN_DOMINOES, -90> quarter_turn;
+
+	static constexpr PxReal Abs(PxReal value)
+	{
+		return (value < 0.f) ? -value : value;
+	}
+
+	//the second quarter starts at the end of the first one, turned by its yaw: the side step of both is the row spacing
+	static constexpr PxReal row_spacing = Abs(quarter_turn.end.x + SegmentMath::Cos(quarter_turn.end.yaw) * quarter_turn.end.x +
+		SegmentMath::Sin(quarter_turn.end.yaw) * quarter_turn.end.z);
+
+	//how far the segments of a row may reach past its ends, the U-turns bulge out
+	static constexpr PxReal row_reach = cell_size + row_spacing;
+
+	static PxVec3 Forward(PxReal yaw)
+	{
+		return PxVec3(PxSin(yaw), 0.f, PxCos(yaw));
+	}
+
+	static PxU64 Cell(PxI32 x, PxI32 z)
+	{
+		return ((PxU64)(PxU32)x << 32) | (PxU32)z;
+	}
+
+	//dominoes used by a segment
+	static PxU32 SegmentDominoes(const CourseSegment& segment)
+	{
+		switch (segment.type)
+		{
+		case SEGMENT_CORNER:
+			return segment.dominoes + 1;
+		case SEGMENT_BRANCH:
+			return 2 * segment.dominoes + 1;
+		case SEGMENT_HEIGHT:
+			return 0;
+		default:
+			return segment.dominoes;
+		}
+	}
+
+	CourseGenerator::CourseGenerator(const CourseGeneratorDesc& _desc)
+		: desc(_desc), random(_desc.seed), remaining(_desc.dominoes), row(0), footprint(0)
+	{
+		if (!desc.dominoes)
+			throw new Exception("CourseGenerator::CourseGenerator, the course needs at least one domino.");
+
+		//a U-turn reaches past the end of its row
+		PxReal overshoot = 0.f;
+		for (PxU32 i = 0; i < quarter_turn.Count(); i++)
+			overshoot = PxMax(overshoot, quarter_turn.poses[i].z);
+
+		PxReal row_length = desc.extent.x - 2.f * overshoot;
+		PxU32 rows = (PxU32)(desc.extent.y / RowSpacing()) + 1;
+		double capacity = (double)rows * (row_length / COURSE_SPACING) + (double)(rows - 1) * 2 * (TURN_DOMINOES + 1);
+		if ((row_length < min_line * COURSE_SPACING) || (desc.dominoes > capacity))
+			throw new Exception("CourseGenerator::CourseGenerator, the course does not fit in the extent.");
+
+		row_start = -.5f * row_length;
+		row_end = .5f * row_length;
+		row_z = -.5f * desc.extent.y;
+
+		cursor.position = PxVec3(row_start, 0.f, row_z);
+		cursor.yaw = PxHalfPi;
+
+		info.start = PxTransform(cursor.position, PxQuat(cursor.yaw, PxVec3(0.f, 1.f, 0.f)));
+		info.materials.push_back(CourseMaterial{ .2f, .2f, .6f });
+		info.colors.push_back(PxVec3(1.f, 1.f, 1.f));
+		info.colors.push_back(PxVec3(.9f, .75f, .3f));
+		info.colors.push_back(PxVec3(.35f, .6f, .9f));
+	}
+
+	PxReal CourseGenerator::RowSpacing()
+	{
+		return row_spacing;
+	}
+
+	template<class Kind>
+	void CourseGenerator::LayoutKind(PxU32 dominoes, PxReal value, Cursor& end, vector<PxVec3>& positions, const Cursor& start)
+	{
+		PxTransform base(start.position, PxQuat(start.yaw, PxVec3(0.f, 1.f, 0.f)));
+
+		vector<LocalPose> poses(Kind::Count(dominoes));
+		LocalPose last = Kind::Fill(dominoes, value, poses.data());
+		for (unsigned int i = 0; i < poses.size(); i++)
+			positions.push_back(base.transform(PxVec3(poses[i].x, poses[i].y, poses[i].z)));
+
+		end.position = base.transform(PxVec3(last.x, last.y, last.z));
+		end.yaw = start.yaw + last.yaw;
+	}
+
+	void CourseGenerator::Layout(const CourseSegment& segment, Cursor& end, vector<PxVec3>& positions, const Cursor& start)
+	{
+		end = start;
+
+		switch (segment.type)
+		{
+		case SEGMENT_LINE:
+			LayoutKind<LineKind>(segment.dominoes, segment.value, end, positions, start);
+			break;
+		case SEGMENT_STAIRS_UP:
+			LayoutKind<StairsKind<1> >(segment.dominoes, segment.value, end, positions, start);
+			break;
+		case SEGMENT_STAIRS_DOWN:
+			LayoutKind<StairsKind<-1> >(segment.dominoes, segment.value, end, positions, start);
+			break;
+		case SEGMENT_CORNER:
+			LayoutKind<CornerKind>(segment.dominoes, segment.value, end, positions, start);
+			break;
+		case SEGMENT_BRANCH:
+		{
+			PxVec3 side = PxVec3(PxCos(start.yaw), 0.f, -PxSin(start.yaw)) * ((segment.value > 0.f) ? COURSE_BRANCH_OFFSET : -COURSE_BRANCH_OFFSET);
+			Cursor branch = { start.position + side, start.yaw }, corner_end, line_end;
+			Layout(CourseSegment(SEGMENT_CORNER, segment.dominoes, segment.value), corner_end, positions, branch);
+			Layout(CourseSegment(SEGMENT_LINE, segment.dominoes), line_end, positions, corner_end);
+			end.position = start.position - side;
+			break;
+		}
+		case SEGMENT_HEIGHT:
+			end.position.y = segment.value;
+			break;
+		}
+	}
+
+	bool CourseGenerator::Fits(const vector<PxVec3>& positions, PxReal max_side, PxReal max_reach)
+	{
+		PxReal min_x = row_start - max_reach, max_x = row_end + max_reach;
+		for (unsigned int i = 0; i < positions.size(); i++)
+		{
+			const PxVec3& position = positions[i];
+			if ((position.x < min_x) || (position.x > max_x) || (PxAbs(position.z - row_z) > max_side))
+				return false;
+
+			PxI32 x = (PxI32)PxFloor(position.x / cell_size);
+			PxI32 z = (PxI32)PxFloor(position.z / cell_size);
+
+			//the footprint before this one joins it and may touch it
+			for (PxI32 dx = -1; dx <= 1; dx++)
+			{
+				for (PxI32 dz = -1; dz <= 1; dz++)
+				{
+					unordered_map<PxU64, PxU32>::const_iterator it = cells.find(Cell(x + dx, z + dz));
+					if ((it != cells.end()) && (it->second < footprint))
+						return false;
+					it = previous_cells.find(Cell(x + dx, z + dz));
+					if ((it != previous_cells.end()) && (it->second < footprint))
+						return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool CourseGenerator::Propose(const CourseSegment* segments, PxU32 count, PxReal max_side, PxReal max_reach)
+	{
+		Cursor end = cursor;
+		vector<PxVec3> positions;
+		PxU32 dominoes = 0;
+		for (PxU32 i = 0; i < count; i++)
+		{
+			Cursor start = end;
+			Layout(segments[i], end, positions, start);
+			dominoes += SegmentDominoes(segments[i]);
+		}
+
+		if ((dominoes > remaining) || !Fits(positions, max_side, max_reach))
+			return false;
+
+		footprint++;
+		for (unsigned int i = 0; i < positions.size(); i++)
+			cells[Cell((PxI32)PxFloor(positions[i].x / cell_size), (PxI32)PxFloor(positions[i].z / cell_size))] = footprint;
+
+		PxU32 color = random.Range(0, (PxU32)info.colors.size() - 1);
+		for (PxU32 i = 0; i < count; i++)
+		{
+			pending.push_back(segments[i]);
+			pending.back().color = color;
+		}
+
+		cursor = end;
+		remaining -= dominoes;
+		return true;
+	}
+
+	void CourseGenerator::Plan()
+	{
+		//room left in the current row, the rows alternate between +x and -x
+		PxReal row_left = (row % 2) ? (cursor.position.x - row_start) : (row_end - cursor.position.x);
+
+		if (row_left < min_line * COURSE_SPACING)
+		{
+			PlanTurn();
+			return;
+		}
+
+		PxReal choice = random.Float();
+		if ((choice < desc.branch_probability) && PlanBranch(row_left))
+			return;
+		if ((choice >= desc.branch_probability) && (choice < desc.branch_probability + desc.stairs_probability) && PlanStairs(row_left))
+			return;
+
+		PlanLine(row_left);
+	}
+
+	void CourseGenerator::PlanTurn()
+	{
+		//the last few dominoes run on past the end of the row, out of the field if need be, but clear of the course
+		if (remaining <= 2 * (TURN_DOMINOES + 1))
+		{
+			CourseSegment line(SEGMENT_LINE, remaining, 1.98f);
+			if (!Propose(&line, 1, .25f * RowSpacing(), PX_MAX_F32))
+				throw new Exception("CourseGenerator::PlanTurn, the last dominoes cross the course.");
+			return;
+		}
+
+		//even rows turn right from +x to -x, odd rows turn left back again
+		PxReal angle = (row % 2) ? PxHalfPi : -PxHalfPi;
+		CourseSegment turn[2] = { CourseSegment(SEGMENT_CORNER, TURN_DOMINOES, angle), CourseSegment(SEGMENT_CORNER, TURN_DOMINOES, angle) };
+
+		//the turn is the first footprint of the next row
+		previous_cells.swap(cells);
+		cells.clear();
+		row++;
+		row_z += RowSpacing();
+
+		if (!Propose(turn, 2, RowSpacing() * 1.5f, row_reach))
+			throw new Exception("CourseGenerator::PlanTurn, the U-turn does not fit.");
+	}
+
+	bool CourseGenerator::PlanBranch(PxReal row_left)
+	{
+		PxU32 branch_dominoes = random.Range(6, 10);
+		PxReal angle = PxPi / 180.f * random.Range(20, 40);
+		PxU32 line_dominoes = random.Range(min_line, 40);
+
+		if (line_dominoes * COURSE_SPACING > row_left)
+			return false;
+
+		//the main line steps over to the side away from the branch, step it back towards the middle of the row
+		if (-PxSin(cursor.yaw) * (cursor.position.z - row_z) < 0.f)
+			angle = -angle;
+
+		//a branch stays clear of the neighbouring rows
+		CourseSegment fork[2] = { CourseSegment(SEGMENT_BRANCH, branch_dominoes, angle), CourseSegment(SEGMENT_LINE, line_dominoes, 1.98f) };
+		return Propose(fork, 2, .5f * RowSpacing() - cell_size, row_reach);
+	}
+
+	bool CourseGenerator::PlanStairs(PxReal row_left)
+	{
+		//stairs start from the ground and come back down to it
+		if (cursor.position.y > 0.f)
+			return false;
+
+		PxU32 steps = random.Range(10, 50);
+		if (2 * steps * COURSE_SPACING > row_left)
+			return false;
+
+		CourseSegment stairs[2] = { CourseSegment(SEGMENT_STAIRS_UP, steps), CourseSegment(SEGMENT_STAIRS_DOWN, steps) };
+		if (!Propose(stairs, 2, .25f * RowSpacing(), row_reach))
+			return false;
+
+		cursor.position.y = 0.f;
+		return true;
+	}
+
+	void CourseGenerator::PlanLine(PxReal row_left)
+	{
+		PxU32 dominoes = PxMin(PxMin(random.Range(min_line, 200), (PxU32)(row_left / COURSE_SPACING)), remaining);
+		CourseSegment line(SEGMENT_LINE, dominoes, 1.98f);
+
+		if (!Propose(&line, 1, .25f * RowSpacing(), row_reach))
+			throw new Exception("CourseGenerator::PlanLine, the course crosses itself.");
+	}
+
+	bool CourseGenerator::Next(CourseSegment& segment)
+	{
+		while (pending.empty())
+		{
+			if (!remaining)
+				return false;
+			Plan();
+		}
+
+		segment = pending.front();
+		pending.pop_front();
+		return true;
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "CourseSegments.h"
+#include <deque>
+#include <unordered_map>
+
+namespace PhysicsEngine
+{
+	///Settings of a generated course
+	struct CourseGeneratorDesc
+	{
+		//the same seed and settings always give the same course
+		PxU64 seed;
+		//exact number of dominoes in the course
+		PxU32 dominoes;
+		//size of the field on the ground (x, z): the course runs in rows along x, stacked along z
+		PxVec2 extent;
+		//chance of a side branch and of a pair of up and down stairs at each segment
+		PxReal branch_probability;
+		PxReal stairs_probability;
+
+		CourseGeneratorDesc() : seed(1), dominoes(1000), extent(20.f, 20.f), branch_probability(.1f), stairs_probability(.2f) {}
+	};
+
+	///Seeded course generator: lines, corners, stairs and branches laid out in rows with U-turns.
+	///Segments are produced as they are read, the footprint of each one is checked against the current
+	///and the previous row so that the course never crosses itself.
+	class CourseGenerator : public CourseReader
+	{
+		//xorshift64*, the same sequence on every platform
+		class Random
+		{
+			PxU64 state;
+
+		public:
+			Random(PxU64 seed) : state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+
+			PxU64 Next()
+			{
+				state ^= state >> 12;
+				state ^= state << 25;
+				state ^= state >> 27;
+				return state * 0x2545F4914F6CDD1Dull;
+			}
+
+			///Uniform in [0, 1)
+			PxReal Float() { return (PxReal)(Next() >> 40) / (PxReal)(1ull << 24); }
+
+			///Uniform in [low, high]
+			PxU32 Range(PxU32 low, PxU32 high) { return low + (PxU32)(Next() % (high - low + 1)); }
+		};
+
+		//layout state: where the next segment starts
+		struct Cursor
+		{
+			PxVec3 position;
+			PxReal yaw;
+		};
+
+		CourseGeneratorDesc desc;
+		CourseInfo info;
+		Random random;
+		Cursor cursor;
+		PxU32 remaining;
+		//current row, its ends along x and its line along z
+		PxU32 row;
+		PxReal row_start, row_end, row_z;
+		//segments planned but not read yet
+		std::deque<CourseSegment> pending;
+		//occupied cells of the current and the previous row, with the id of the footprint
+		std::unordered_map<PxU64, PxU32> cells, previous_cells;
+		PxU32 footprint;
+
+		//domino positions of a segment kind laid from start, from the same local poses MyScene places
+		template<class Kind>
+		static void LayoutKind(PxU32 dominoes, PxReal value, Cursor& end, std::vector<PxVec3>& positions, const Cursor& start);
+
+		//domino positions of a segment laid from start
+		static void Layout(const CourseSegment& segment, Cursor& end, std::vector<PxVec3>& positions, const Cursor& start);
+
+		//check positions against the course so far, only the last footprint may touch them.
+		//They may lie max_side off the row line and max_reach past the ends of the row.
+		bool Fits(const std::vector<PxVec3>& positions, PxReal max_side, PxReal max_reach);
+
+		//queue segments from the cursor as one footprint if they fit and there are enough dominoes left
+		bool Propose(const CourseSegment* segments, PxU32 count, PxReal max_side, PxReal max_reach);
+
+		//plan the next segments
+		void Plan();
+
+		void PlanTurn();
+
+		bool PlanBranch(PxReal row_left);
+
+		bool PlanStairs(PxReal row_left);
+
+		void PlanLine(PxReal row_left);
+
+	public:
+		///Dominoes in each quarter of a U-turn
+		static const PxU32 TURN_DOMINOES = 16;
+
+		///Throws if the course does not fit in the extent
+		CourseGenerator(const CourseGeneratorDesc& _desc);
+
+		virtual const CourseInfo& Info() { return info; }
+
+		virtual bool Next(CourseSegment& segment);
+
+		///Distance between two rows
+		static PxReal RowSpacing();
+	};
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "CourseFile.h"
+
+namespace PhysicsEngine
+{
+	using namespace physx;
+
+	///Constant expression maths for the segment tables
+	namespace SegmentMath
+	{
+		constexpr PxReal pi = 3.14159265358979f;
+
+		///Sine by its Taylor series after reducing the angle to [-pi, pi]
+		constexpr PxReal Sin(PxReal angle)
+		{
+			while (angle > pi)
+				angle -= 2.f * pi;
+			while (angle < -pi)
+				angle += 2.f * pi;
+
+			PxReal term = angle, sum = angle;
+			for (int i = 1; i < 12; i++)
+			{
+				term *= -angle * angle / (PxReal)((2 * i) * (2 * i + 1));
+				sum += term;
+			}
+			return sum;
+		}
+
+		constexpr PxReal Cos(PxReal angle)
+		{
+			return Sin(angle + .5f * pi);
+		}
+	}
+
+	///Pose of a domino relative to the start of its segment (x right, y up, z forward), turned by yaw about y.
+	///The quaternion of the yaw is kept as well, so placing a domino needs no trigonometry.
+	struct LocalPose
+	{
+		PxReal x, y, z;
+		PxReal yaw;
+		PxReal qy, qw;
+
+		PxTransform Transform() const { return PxTransform(PxVec3(x, y, z), PxQuat(0.f, qy, 0.f, qw)); }
+	};
+
+	constexpr LocalPose YawPose(PxReal x, PxReal y, PxReal z, PxReal yaw)
+	{
+		return LocalPose{ x, y, z, yaw, SegmentMath::Sin(.5f * yaw), SegmentMath::Cos(.5f * yaw) };
+	}
+
+	///Segment kinds: Count dominoes, Fill writes their local poses and returns where the next segment starts
+
+	///Straight line along the forward axis
+	struct LineKind
+	{
+		static constexpr PxU32 Count(PxU32 dominoes) { return dominoes; }
+
+		static constexpr LocalPose Fill(PxU32 dominoes, PxReal value, LocalPose* poses)
+		{
+			for (PxU32 i = 0; i < dominoes; i++)
+				poses[i] = YawPose(0.f, 0.f, COURSE_SPACING * i, 0.f);
+			return YawPose(0.f, 0.f, COURSE_SPACING * dominoes, 0.f);
+		}
+	};
+
+	///Line rising (Direction 1) or falling (Direction -1) by one stair per domino
+	template<int Direction>
+	struct StairsKind
+	{
+		static constexpr PxU32 Count(PxU32 dominoes) { return dominoes; }
+
+		static constexpr LocalPose Fill(PxU32 dominoes, PxReal value, LocalPose* poses)
+		{
+			for (PxU32 i = 0; i < dominoes; i++)
+				poses[i] = YawPose(0.f, Direction * COURSE_RISE * i, COURSE_SPACING * i, 0.f);
+			return YawPose(0.f, Direction * COURSE_RISE * dominoes, COURSE_SPACING * dominoes, 0.f);
+		}
+	};
+
+	///Curve turning by value radians in equal steps, one domino more than the steps
+	struct CornerKind
+	{
+		static constexpr PxU32 Count(PxU32 dominoes) { return dominoes + 1; }
+
+		static constexpr LocalPose Fill(PxU32 dominoes, PxReal angle, LocalPose* poses)
+		{
+			//every domino is one spacing ahead of the previous one along its own heading,
+			//the first one starts from a point one spacing behind the start
+			PxReal step = angle / dominoes;
+			PxReal x = -COURSE_SPACING * SegmentMath::Sin(step);
+			PxReal z = -COURSE_SPACING * SegmentMath::Cos(step);
+			for (PxU32 i = 0; i <= dominoes; i++)
+			{
+				x += COURSE_SPACING * SegmentMath::Sin(step * i);
+				z += COURSE_SPACING * SegmentMath::Cos(step * i);
+				poses[i] = YawPose(x, 0.f, z, step * i);
+			}
+			return YawPose(x + COURSE_SPACING * SegmentMath::Sin(angle), 0.f, z + COURSE_SPACING * SegmentMath::Cos(angle), angle);
+		}
+	};
+
+	///Local poses of a segment with its parameters known at compile time, e.g.
+	///  static constexpr SegmentTable<CornerKind, 16, -90> quarter_turn;
+	template<class Kind, PxU32 Dominoes, int Degrees=0>
+	struct SegmentTable
+	{
+		LocalPose poses[Kind::Count(Dominoes)];
+		LocalPose end;
+
+		constexpr SegmentTable() : poses(), end(Kind::Fill(Dominoes, Degrees * SegmentMath::pi / 180.f, poses)) {}
+
+		static constexpr PxU32 Count() { return Kind::Count(Dominoes); }
+	};
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+#include <vector>
+#include <string>
+#include <atomic>
+
+///A single shape as published by the simulation
+struct ShapePose
+{
+	physx::PxGeometryHolder geometry;
+	physx::PxTransform pose;
+	physx::PxVec3 color;
+};
+
+///Cloth particles as published by the simulation
+struct ClothPose
+{
+	physx::PxTransform pose;
+	physx::PxVec3 color;
+	physx::PxClothMeshDesc* mesh_desc;
+	std::vector<physx::PxVec3> verts;
+};
+
+///Particle marbles as published by the simulation
+struct ParticlesPose
+{
+	physx::PxVec3 color;
+	std::vector<physx::PxVec3> positions;
+};
+
+///Everything the renderer needs to draw the result of one simulation step
+struct PoseFrame
+{
+	std::vector<ShapePose> shapes;
+	std::vector<ClothPose> cloths;
+	std::vector<ParticlesPose> particles;
+	std::string status;
+	physx::PxU32 step;
+	bool paused;
+	bool done;
+
+	PoseFrame() : step(0), paused(false), done(false) {}
+};
+
+///Lock-free triple buffer of frames.
+///The simulation thread fills one frame while the renderer reads another; the third holds the latest published one.
+class PoseBuffer
+{
+	static const int INDEX_MASK = 3;
+	static const int UNREAD = 4;
+
+	PoseFrame frames[3];
+	//index of the last published frame, with UNREAD set until the renderer picks it up
+	std::atomic<int> ready;
+	int write_index;
+	int read_index;
+
+public:
+	PoseBuffer() : ready(1), write_index(0), read_index(2) {}
+
+	///Frame to fill by the writer
+	PoseFrame& WriteFrame()
+	{
+		return frames[write_index];
+	}
+
+	///Publish the filled frame and get a new one to write to
+	void Publish()
+	{
+		write_index = ready.exchange(write_index | UNREAD) & INDEX_MASK;
+	}
+
+	///Latest published frame, valid until the next call
+	const PoseFrame& Read()
+	{
+		if (ready.load() & UNREAD)
+			read_index = ready.exchange(read_index) & INDEX_MASK;
+		return frames[read_index];
+	}
+};
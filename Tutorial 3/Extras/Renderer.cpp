@@ -1,6 +1,7 @@
 #include "Renderer.h"
 #include <iostream>
 #include <vector>
+#include <unordered_map>
 #include "UserData.h"
 
 using namespace std;
@@ -13,6 +14,8 @@ namespace VisualDebugger
 		PxVec3 background_color = PxVec3(0.f, 0.f, 0.f);
 		int render_detail = 10;
 		bool show_shadows = true;
+		//particles are drawn as points of this size in pixels
+		float particle_size = 4.f;
 
 		static float gPlaneData[] = {
 			-1.f, 0.f, -1.f, 0.f, 1.f, 0.f, -1.f, 0.f, 1.f, 0.f, 1.f, 0.f,
@@ -102,28 +105,123 @@ namespace VisualDebugger
 		{
 			PxTriangleMesh* mesh = geometry.triangleMesh().triangleMesh;
 			const PxVec3* verts = mesh->getVertices();
-			PxU16* trigs = (PxU16*)mesh->getTriangles();
 			const PxU32 num_trigs = mesh->getNbTriangles();
+			//the cooking picks 16-bit indices for small meshes
+			bool indices_16bit = mesh->getTriangleMeshFlags().isSet(PxTriangleMeshFlag::e16_BIT_INDICES);
+			const PxU16* trigs16 = (const PxU16*)mesh->getTriangles();
+			const PxU32* trigs32 = (const PxU32*)mesh->getTriangles();
 
+			//one batch for the whole mesh
+			glBegin(GL_TRIANGLES);
 			for (PxU32 i = 0; i < num_trigs * 3; i += 3)
 			{
-				PxVec3 v0 = verts[trigs[i]];
-				PxVec3 v1 = verts[trigs[i + 1]];
-				PxVec3 v2 = verts[trigs[i + 2]];
+				PxVec3 v0 = verts[indices_16bit ? trigs16[i] : trigs32[i]];
+				PxVec3 v1 = verts[indices_16bit ? trigs16[i + 1] : trigs32[i + 1]];
+				PxVec3 v2 = verts[indices_16bit ? trigs16[i + 2] : trigs32[i + 2]];
 				PxVec3 n = (v1 - v0).cross(v2 - v0);
 				n.normalize();
-				glBegin(GL_POLYGON);
 				glNormal3f(n.x, n.y, n.z);
 				glVertex3f(v0.x, v0.y, v0.z);
 				glVertex3f(v1.x, v1.y, v1.z);
 				glVertex3f(v2.x, v2.y, v2.z);
-				glEnd();
 			}
+			glEnd();
+		}
+
+		//heightfield triangles compiled into a display list on first use, kept until ReleaseHeightFields
+		struct HeightFieldList
+		{
+			GLuint list;
+			PxU32 timestamp;
+			PxReal height_scale, row_scale, column_scale;
+		};
+
+		static unordered_map<const PxHeightField*, HeightFieldList> heightfield_lists;
+
+		static void CompileHeightField(const PxHeightFieldGeometry& geometry, GLuint list)
+		{
+			const PxHeightField* field = geometry.heightField;
+			PxU32 rows = field->getNbRows();
+			PxU32 columns = field->getNbColumns();
+			vector<PxHeightFieldSample> samples(rows * columns);
+			field->saveCells(samples.data(), (PxU32)(samples.size() * sizeof(PxHeightFieldSample)));
+
+			//vertices and normals in the shape space, rows along x and columns along z
+			vector<PxVec3> verts(samples.size());
+			vector<PxVec3> normals(samples.size());
+			for (PxU32 r = 0; r < rows; r++)
+				for (PxU32 c = 0; c < columns; c++)
+					verts[r * columns + c] = PxVec3(r * geometry.rowScale, samples[r * columns + c].height * geometry.heightScale, c * geometry.columnScale);
+
+			for (PxU32 r = 0; r < rows; r++)
+			{
+				for (PxU32 c = 0; c < columns; c++)
+				{
+					//central differences, one-sided at the borders
+					PxVec3 along_rows = verts[PxMin(r + 1, rows - 1) * columns + c] - verts[(r ? r - 1 : 0) * columns + c];
+					PxVec3 along_columns = verts[r * columns + PxMin(c + 1, columns - 1)] - verts[r * columns + (c ? c - 1 : 0)];
+					normals[r * columns + c] = along_columns.cross(along_rows).getNormalized();
+				}
+			}
+
+			glNewList(list, GL_COMPILE);
+			glBegin(GL_TRIANGLES);
+			for (PxU32 r = 0; r + 1 < rows; r++)
+			{
+				for (PxU32 c = 0; c + 1 < columns; c++)
+				{
+					const PxHeightFieldSample& sample = samples[r * columns + c];
+					PxU32 v00 = r * columns + c, v01 = v00 + 1, v10 = v00 + columns, v11 = v10 + 1;
+					//the tesselation flag picks the diagonal of the cell
+					bool tess = sample.tessFlag() != 0;
+					PxU32 trigs[6] = { v00, v01, tess ? v11 : v10, tess ? v00 : v01, v11, v10 };
+
+					for (PxU32 t = 0; t < 2; t++)
+					{
+						PxU8 material = t ? sample.materialIndex1 : sample.materialIndex0;
+						if (material == PxHeightFieldMaterial::eHOLE)
+							continue;
+
+						for (PxU32 j = t * 3; j < t * 3 + 3; j++)
+						{
+							const PxVec3& n = normals[trigs[j]];
+							const PxVec3& v = verts[trigs[j]];
+							glNormal3f(n.x, n.y, n.z);
+							glVertex3f(v.x, v.y, v.z);
+						}
+					}
+				}
+			}
+			glEnd();
+			glEndList();
 		}
 
 		void DrawHeightField(const PxGeometryHolder& geometry)
 		{
-			//TODO
+			const PxHeightFieldGeometry& field = geometry.heightField();
+			HeightFieldList& cached = heightfield_lists[field.heightField];
+
+			//samples or scales changed since the list was compiled
+			if (!cached.list || (cached.timestamp != field.heightField->getTimestamp()) || (cached.height_scale != field.heightScale) ||
+				(cached.row_scale != field.rowScale) || (cached.column_scale != field.columnScale))
+			{
+				if (!cached.list)
+					cached.list = glGenLists(1);
+				cached.timestamp = field.heightField->getTimestamp();
+				cached.height_scale = field.heightScale;
+				cached.row_scale = field.rowScale;
+				cached.column_scale = field.columnScale;
+				CompileHeightField(field, cached.list);
+			}
+
+			glCallList(cached.list);
+		}
+
+		void ReleaseHeightFields()
+		{
+			for (unordered_map<const PxHeightField*, HeightFieldList>::iterator it = heightfield_lists.begin(); it != heightfield_lists.end(); ++it)
+				glDeleteLists(it->second.list, 1);
+			heightfield_lists.clear();
 		}
 
 		void RenderGeometry(const PxGeometryHolder& geometry)
@@ -156,29 +254,13 @@ namespace VisualDebugger
 			}
 		}
 
-		void RenderCloth(const PxCloth* cloth)
+		void RenderCloth(const PxClothMeshDesc* mesh_desc, const std::vector<PxVec3>& verts, const PxTransform& pose, const PxVec3& color)
 		{
-			PxClothMeshDesc* mesh_desc = ((UserData*)cloth->userData)->cloth_mesh_desc;
-			PxVec3* color = ((UserData*)cloth->userData)->color;
-
 			PxU32 quad_count = mesh_desc->quads.count;
 			PxU32* quads = (PxU32*)mesh_desc->quads.data;
 
-			std::vector<PxVec3> verts(cloth->getNbParticles());
 			std::vector<PxVec3> norms(verts.size(), PxVec3(0.f, 0.f, 0.f));
 
-			//get verts data
-			cloth->lockParticleData();
-
-			PxClothParticleData* particle_data = cloth->lockParticleData();
-			if (!particle_data)
-				return;
-			// copy vertex positions
-			for (PxU32 j = 0; j < verts.size(); j++)
-				verts[j] = particle_data->particles[j].pos;
-
-			particle_data->unlock();
-
 			for (PxU32 i = 0; i < quad_count * 4; i += 4)
 			{
 				PxVec3 v0 = verts[quads[i]];
@@ -195,10 +277,9 @@ namespace VisualDebugger
 			for (PxU32 i = 0; i < norms.size(); i++)
 				norms[i].normalize();
 
-			PxTransform pose = cloth->getGlobalPose();
 			PxMat44 shapePose(pose);
 
-			glColor4f(color->x, color->y, color->z, 1.f);
+			glColor4f(color.x, color.y, color.z, 1.f);
 
 			glPushMatrix();
 			glMultMatrixf((float*)&shapePose);
@@ -217,6 +298,101 @@ namespace VisualDebugger
 			glPopMatrix();
 		}
 
+		void RenderCloth(const PxCloth* cloth)
+		{
+			PxClothMeshDesc* mesh_desc = ((UserData*)cloth->userData)->cloth_mesh_desc;
+			PxVec3* color = ((UserData*)cloth->userData)->color;
+
+			std::vector<PxVec3> verts(cloth->getNbParticles());
+
+			//get verts data
+			PxClothParticleData* particle_data = cloth->lockParticleData();
+			if (!particle_data)
+				return;
+			// copy vertex positions
+			for (PxU32 j = 0; j < verts.size(); j++)
+				verts[j] = particle_data->particles[j].pos;
+
+			particle_data->unlock();
+
+			RenderCloth(mesh_desc, verts, cloth->getGlobalPose(), *color);
+		}
+
+		void RenderParticles(const std::vector<PxVec3>& positions, const PxVec3& color, const PxVec3& shadow_color)
+		{
+			if (positions.empty())
+				return;
+
+			//thousands of marbles are too many for spheres, round points stand in for them
+			glDisable(GL_LIGHTING);
+			glEnable(GL_POINT_SMOOTH);
+			glPointSize(particle_size);
+
+			glEnableClientState(GL_VERTEX_ARRAY);
+			glVertexPointer(3, GL_FLOAT, sizeof(PxVec3), &positions.front());
+
+			glColor4f(color.x, color.y, color.z, 1.f);
+			glDrawArrays(GL_POINTS, 0, (GLsizei)positions.size());
+
+			if (show_shadows)
+			{
+				const PxVec3 shadowDir(-0.7071067f, -0.7071067f, -0.7071067f);
+				const PxReal shadowMat[] = { 1,0,0,0, -shadowDir.x / shadowDir.y,0,-shadowDir.z / shadowDir.y,0, 0,0,1,0, 0,0,0,1 };
+				glPushMatrix();
+				glMultMatrixf(shadowMat);
+				glColor4f(shadow_color.x, shadow_color.y, shadow_color.z, 1.f);
+				glDrawArrays(GL_POINTS, 0, (GLsizei)positions.size());
+				glPopMatrix();
+			}
+
+			glDisableClientState(GL_VERTEX_ARRAY);
+
+			glPointSize(1.f);
+			glDisable(GL_POINT_SMOOTH);
+			glEnable(GL_LIGHTING);
+		}
+
+		void RenderShape(const PxGeometryHolder& h, PxTransform pose, const PxVec3& shape_color, const PxVec3& shadow_color)
+		{
+			//move the plane slightly down to avoid visual artefacts
+			if (h.getType() == PxGeometryType::ePLANE)
+			{
+				pose.q *= PxQuat(PxHalfPi, PxVec3(0.f, 0.f, 1.f));
+				pose.p += PxVec3(0, -0.01, 0);
+			}
+
+			PxMat44 shapePose(pose);
+			// render object
+			glPushMatrix();
+			glMultMatrixf((float*)&shapePose);
+
+			if (h.getType() == PxGeometryType::ePLANE)
+				glDisable(GL_LIGHTING);
+
+			glColor4f(shape_color.x, shape_color.y, shape_color.z, 1.f);
+
+			RenderGeometry(h);
+
+			if (h.getType() == PxGeometryType::ePLANE)
+				glEnable(GL_LIGHTING);
+
+			glPopMatrix();
+
+			if (show_shadows && (h.getType() != PxGeometryType::ePLANE))
+			{
+				const PxVec3 shadowDir(-0.7071067f, -0.7071067f, -0.7071067f);
+				const PxReal shadowMat[] = { 1,0,0,0, -shadowDir.x / shadowDir.y,0,-shadowDir.z / shadowDir.y,0, 0,0,1,0, 0,0,0,1 };
+				glPushMatrix();
+				glMultMatrixf(shadowMat);
+				glMultMatrixf((float*)&shapePose);
+				glDisable(GL_LIGHTING);
+				glColor4f(shadow_color.x, shadow_color.y, shadow_color.z, 1.f);
+				RenderGeometry(h);
+				glEnable(GL_LIGHTING);
+				glPopMatrix();
+			}
+		}
+
 		void reshapeCallback(int width, int height)
 		{
 			glViewport(0, 0, width, height);
@@ -289,6 +465,8 @@ namespace VisualDebugger
 		void Render(PxActor** actors, const PxU32 numActors)
 		{
 			PxVec3 shadow_color = default_color * 0.9;
+			//particles come after the plane, which sets the shadow colour
+			std::vector<PxParticleSystem*> particle_systems;
 			for (PxU32 i = 0; i < numActors; i++) {
 #if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
 				if (actors[i]->isCloth()) {
@@ -297,11 +475,22 @@ namespace VisualDebugger
 #endif
 					RenderCloth((PxCloth*)actors[i]);
 				}
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+				else if (actors[i]->isParticleSystem()) {
+#else
+				else if (actors[i]->is<PxParticleSystem>()) {
+#endif
+					particle_systems.push_back((PxParticleSystem*)actors[i]);
+				}
 #if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
 				else if (actors[i]->isRigidActor()) {
 #else
 				else if (actors[i]->is<PxRigidActor>()) {
 #endif
+					//parked actors are hidden
+					if (actors[i]->getActorFlags() & PxActorFlag::eDISABLE_SIMULATION)
+						continue;
+
 					PxRigidActor* rigid_actor = (PxRigidActor*)actors[i];
 					std::vector<PxShape*> shapes(rigid_actor->getNbShapes());
 					rigid_actor->getShapes((PxShape**)&shapes.front(), (PxU32)shapes.size());
@@ -309,61 +498,57 @@ namespace VisualDebugger
 					for (PxU32 j = 0; j < shapes.size(); j++)
 					{
 						const PxShape* shape = shapes[j];
-						PxTransform pose = PxShapeExt::getGlobalPose(*shape, *shape->getActor());
 						PxGeometryHolder h = shape->getGeometry();
-						//move the plane slightly down to avoid visual artefacts
-						if (h.getType() == PxGeometryType::ePLANE)
-						{
-							pose.q *= PxQuat(PxHalfPi, PxVec3(0.f, 0.f, 1.f));
-							pose.p += PxVec3(0, -0.01, 0);
-						}
-
-						PxMat44 shapePose(pose);
-						// render object
-						glPushMatrix();
-						glMultMatrixf((float*)&shapePose);
 
 						PxVec3 shape_color = default_color;
+						PxVec3* color = ShapeColor(shape, rigid_actor);
 
-						if (shape->userData)
+						if (color)
 						{
-							shape_color = *(((UserData*)shape->userData)->color);
+							shape_color = *color;
 							if (h.getType() == PxGeometryType::ePLANE)
 							{
 								shadow_color = shape_color * 0.9;
 							}
 						}
 
-						if (h.getType() == PxGeometryType::ePLANE)
-							glDisable(GL_LIGHTING);
+						RenderShape(h, PxShapeExt::getGlobalPose(*shape, *shape->getActor()), shape_color, shadow_color);
+					}
+				}
+			}
 
-						glColor4f(shape_color.x, shape_color.y, shape_color.z, 1.f);
+			std::vector<PxVec3> positions;
+			for (PxU32 i = 0; i < particle_systems.size(); i++)
+			{
+				UserData* data = (UserData*)particle_systems[i]->userData;
+				ParticlePositions(particle_systems[i], positions);
+				RenderParticles(positions, (data && data->color) ? *data->color : default_color, shadow_color);
+			}
+		}
 
-						RenderGeometry(h);
+		void Render(const PoseFrame& frame)
+		{
+			PxVec3 shadow_color = default_color * 0.9;
 
-						if (h.getType() == PxGeometryType::ePLANE)
-							glEnable(GL_LIGHTING);
+			for (PxU32 i = 0; i < frame.cloths.size(); i++)
+			{
+				const ClothPose& cloth = frame.cloths[i];
+				if (cloth.mesh_desc && cloth.verts.size())
+					RenderCloth(cloth.mesh_desc, cloth.verts, cloth.pose, cloth.color);
+			}
 
-						glPopMatrix();
+			for (PxU32 i = 0; i < frame.shapes.size(); i++)
+			{
+				const ShapePose& shape = frame.shapes[i];
+				if (shape.geometry.getType() == PxGeometryType::ePLANE)
+					shadow_color = shape.color * 0.9;
 
-						if (show_shadows && (h.getType() != PxGeometryType::ePLANE))
-						{
-							const PxVec3 shadowDir(-0.7071067f, -0.7071067f, -0.7071067f);
-							const PxReal shadowMat[] = { 1,0,0,0, -shadowDir.x / shadowDir.y,0,-shadowDir.z / shadowDir.y,0, 0,0,1,0, 0,0,0,1 };
-							glPushMatrix();
-							glMultMatrixf(shadowMat);
-							glMultMatrixf((float*)&shapePose);
-							glDisable(GL_LIGHTING);
-							glColor4f(shadow_color.x, shadow_color.y, shadow_color.z, 1.f);
-							RenderGeometry(h);
-							glEnable(GL_LIGHTING);
-							glPopMatrix();
-						}
-					}
-				}
+				RenderShape(shape.geometry, shape.pose, shape.color, shadow_color);
+			}
 
-				}
-				}
+			for (PxU32 i = 0; i < frame.particles.size(); i++)
+				RenderParticles(frame.particles[i].positions, frame.particles[i].color, shadow_color);
+		}
 
 		void Finish()
 		{
@@ -2,6 +2,7 @@
 
 #include "PxPhysicsAPI.h"
 #include "GLFontRenderer.h"
+#include "PoseBuffer.h"
 #include <GL/glut.h>
 #include <string>
 
@@ -23,6 +24,9 @@ namespace VisualDebugger
 		///Render actors
 		void Render(PxActor** actors, const PxU32 numActors);
 
+		///Render a frame published by the simulation thread
+		void Render(const PoseFrame& frame);
+
 		///Render debug information
 		void Render(const PxRenderBuffer& data, PxReal line_width=1.f);
 
@@ -36,6 +40,9 @@ namespace VisualDebugger
 		///Finish rendering a single frame
 		void Finish();
 
+		///Delete the display lists of the heightfields drawn so far, call when the scene is rebuilt (a new heightfield may reuse an address)
+		void ReleaseHeightFields();
+
 		///Set rendering detail for spheres and capsules.
 		void SetRenderDetail(int value);
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "PxPhysicsAPI.h"
+#include <vector>
 
 //add here any other structures that you want to pass from your simulation to the renderer
 class UserData
@@ -11,4 +12,34 @@ public:
 
 	UserData(physx::PxVec3* _color=0, physx::PxClothMeshDesc* _cloth_mesh_desc=0) :
 		color(_color), cloth_mesh_desc(_cloth_mesh_desc) {}
-};
\ No newline at end of file
+};
+
+///Colour of a shape as shown by the renderer.
+///Shared shapes cannot hold per-actor data, so their colour is kept by the actor.
+inline physx::PxVec3* ShapeColor(const physx::PxShape* shape, const physx::PxRigidActor* actor)
+{
+	if (!shape->isExclusive() && actor->userData)
+		return ((UserData*)actor->userData)->color;
+	else if (shape->userData)
+		return ((UserData*)shape->userData)->color;
+	else
+		return 0;
+}
+
+///Positions of the live particles of a particle system, as shown by the renderer
+inline void ParticlePositions(physx::PxParticleSystem* system, std::vector<physx::PxVec3>& positions)
+{
+	positions.clear();
+	physx::PxParticleReadData* data = system->lockParticleReadData(physx::PxDataAccessFlag::eREADABLE);
+	if (!data)
+		return;
+
+	physx::PxStrideIterator<const physx::PxParticleFlags> flags(data->flagsBuffer);
+	physx::PxStrideIterator<const physx::PxVec3> particles(data->positionBuffer);
+	for (physx::PxU32 i = 0; i < data->validParticleRange; i++)
+	{
+		if (flags[i] & physx::PxParticleFlag::eVALID)
+			positions.push_back(particles[i]);
+	}
+	data->unlock();
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "FloorBuilder.h"
+
+namespace PhysicsEngine
+{
+	using namespace std;
+
+	//the faces of a box as quads of corner indices (bit 0: x, bit 1: y, bit 2: z), counter-clockwise from outside
+	static const PxU32 box_faces[6][4] = { {0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6} };
+
+	void FloorBuilder::Add(const PxTransform& pose, const PxVec3& dimensions)
+	{
+		poses.push_back(pose);
+		half_extents.push_back(dimensions);
+	}
+
+	vector<Actor*> FloorBuilder::Build(FloorType type)
+	{
+		vector<Actor*> actors;
+		if (poses.empty())
+			return actors;
+
+		if (type == FLOOR_BOXES)
+		{
+			for (unsigned int i = 0; i < poses.size(); i++)
+				actors.push_back(new SBox(poses[i], half_extents[i]));
+		}
+		else if (type == FLOOR_SHAPES)
+		{
+			StaticActor* floor = new StaticActor(PxTransform(PxIdentity));
+			for (unsigned int i = 0; i < poses.size(); i++)
+			{
+				floor->CreateShape(PxBoxGeometry(half_extents[i]));
+				floor->GetShape(i)->setLocalPose(poses[i]);
+			}
+			actors.push_back(floor);
+		}
+		else
+		{
+			vector<PxVec3> verts;
+			vector<PxU32> trigs;
+			verts.reserve(poses.size() * 8);
+			trigs.reserve(poses.size() * 36);
+
+			for (unsigned int i = 0; i < poses.size(); i++)
+			{
+				PxU32 base = (PxU32)verts.size();
+				for (PxU32 corner = 0; corner < 8; corner++)
+				{
+					PxVec3 local((corner & 1) ? half_extents[i].x : -half_extents[i].x,
+						(corner & 2) ? half_extents[i].y : -half_extents[i].y,
+						(corner & 4) ? half_extents[i].z : -half_extents[i].z);
+					verts.push_back(poses[i].transform(local));
+				}
+
+				for (PxU32 face = 0; face < 6; face++)
+				{
+					const PxU32* quad = box_faces[face];
+					PxU32 quad_trigs[6] = { quad[0], quad[1], quad[2], quad[0], quad[2], quad[3] };
+					for (PxU32 j = 0; j < 6; j++)
+						trigs.push_back(base + quad_trigs[j]);
+				}
+			}
+
+			actors.push_back(new TriangleMesh(verts, trigs));
+		}
+
+		poses.clear();
+		half_extents.clear();
+
+		return actors;
+	}
+}
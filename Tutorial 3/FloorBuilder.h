@@ -0,0 +1,35 @@
+#pragma once
+
+#include "BasicActors.h"
+#include <vector>
+
+namespace PhysicsEngine
+{
+	///Collects the box platforms of a segment and builds them as one static actor
+	class FloorBuilder
+	{
+		std::vector<PxTransform> poses;
+		std::vector<PxVec3> half_extents;
+
+	public:
+		///How the collected boxes become actors
+		enum FloorType
+		{
+			//one SBox per platform
+			FLOOR_BOXES,
+			//one static actor with a box shape per platform
+			FLOOR_SHAPES,
+			//one static actor with a single cooked triangle mesh
+			FLOOR_MESH
+		};
+
+		///Collect a platform
+		void Add(const PxTransform& pose, const PxVec3& dimensions);
+
+		///Check if there are platforms to build
+		bool Empty() const { return poses.empty(); }
+
+		///Create the actors of the collected platforms (not added to a scene) and clear the builder
+		std::vector<Actor*> Build(FloorType type);
+	};
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+
+namespace PhysicsEngine
+{
+	using namespace physx;
+
+	///64-bit FNV-1a hash, used to key cached data by everything that affects it
+	class Hash
+	{
+		PxU64 value;
+
+	public:
+		Hash() : value(14695981039346656037ULL) {}
+
+		void Add(const void* data, size_t size)
+		{
+			const PxU8* bytes = (const PxU8*)data;
+			for (size_t i = 0; i < size; i++)
+			{
+				value ^= bytes[i];
+				value *= 1099511628211ULL;
+			}
+		}
+
+		template<class T>
+		void Add(const T& data)
+		{
+			Add(&data, sizeof(T));
+		}
+
+		//strided array, element by element
+		void Add(const void* data, PxU32 count, PxU32 stride, size_t element_size)
+		{
+			const PxU8* bytes = (const PxU8*)data;
+			for (PxU32 i = 0; i < count; i++)
+				Add(bytes + i * stride, element_size);
+		}
+
+		PxU64 Value() const { return value; }
+	};
+}
@@ -0,0 +1,202 @@
+#include "JobSystem.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace PhysicsEngine
+{
+	using namespace physx;
+	using namespace std;
+
+	//the job system and queue of the current worker thread
+	static thread_local const JobSystem* current_system = 0;
+	static thread_local PxU32 current_queue = 0;
+
+	JobSystem::JobSystem(PxU32 num_threads, const vector<PxU32>& affinity_masks)
+		: queued(0), running(true)
+	{
+		for (PxU32 i = 0; i < num_threads + 1; i++)
+			queues.push_back(new Queue());
+
+		for (PxU32 i = 0; i < num_threads; i++)
+		{
+			//a shorter list of masks is repeated over the workers
+			PxU32 mask = affinity_masks.size() ? affinity_masks[i % affinity_masks.size()] : 0;
+			threads.push_back(thread(&JobSystem::WorkerMain, this, i, mask));
+		}
+	}
+
+	JobSystem::~JobSystem()
+	{
+		{
+			lock_guard<mutex> guard(sleep_lock);
+			running = false;
+		}
+		wake.notify_all();
+
+		for (unsigned int i = 0; i < threads.size(); i++)
+			threads[i].join();
+
+		for (unsigned int i = 0; i < queues.size(); i++)
+			delete queues[i];
+	}
+
+	void JobSystem::submitTask(PxBaseTask& task)
+	{
+		Job job;
+		job.task = &task;
+
+		//no workers: run on the calling thread, as PxDefaultCpuDispatcher does
+		if (threads.empty())
+			Execute(job);
+		else
+			Push(job);
+	}
+
+	PxU32 JobSystem::getWorkerCount() const
+	{
+		return (PxU32)threads.size();
+	}
+
+	void JobSystem::Submit(const function<void()>& function, JobCounter* counter)
+	{
+		Job job;
+		job.function = function;
+		job.counter = counter;
+
+		if (counter)
+			counter->pending++;
+
+		if (threads.empty())
+			Execute(job);
+		else
+			Push(job);
+	}
+
+	void JobSystem::Wait(JobCounter& counter)
+	{
+		PxU32 index = QueueIndex();
+		while (!counter.Done())
+		{
+			Job job;
+			if (Pop(index, job) || Steal(index, job))
+				Execute(job);
+			else
+				this_thread::yield();
+		}
+	}
+
+	void JobSystem::ParallelFor(PxU32 count, const function<void(PxU32 begin, PxU32 end)>& body, PxU32 grain)
+	{
+		if (!count)
+			return;
+
+		//a few chunks per thread (including the caller) to balance uneven work
+		PxU32 chunks = (getWorkerCount() + 1) * 4;
+		PxU32 chunk_size = PxMax(PxMax(grain, (PxU32)1), (count + chunks - 1) / chunks);
+
+		JobCounter counter;
+		for (PxU32 begin = 0; begin < count; begin += chunk_size)
+		{
+			PxU32 end = PxMin(count, begin + chunk_size);
+			Submit([&body, begin, end]() { body(begin, end); }, &counter);
+		}
+		Wait(counter);
+	}
+
+	void JobSystem::WorkerMain(PxU32 index, PxU32 affinity_mask)
+	{
+#ifdef _WIN32
+		if (affinity_mask)
+			SetThreadAffinityMask(GetCurrentThread(), affinity_mask);
+#endif
+		current_system = this;
+		current_queue = index;
+
+		while (running)
+		{
+			Job job;
+			if (Pop(index, job) || Steal(index, job))
+			{
+				Execute(job);
+				continue;
+			}
+
+			unique_lock<mutex> guard(sleep_lock);
+			wake.wait(guard, [this]() { return !running || (queued > 0); });
+		}
+	}
+
+	void JobSystem::Push(Job& job)
+	{
+		//count the job before it can be taken, a worker decrements the count as soon as it pops the job
+		queued++;
+
+		Queue* queue = queues[QueueIndex()];
+		{
+			lock_guard<mutex> guard(queue->lock);
+			queue->jobs.push_back(job);
+		}
+
+		//taking the lock orders the push with a worker that is about to sleep
+		{
+			lock_guard<mutex> guard(sleep_lock);
+		}
+		wake.notify_one();
+	}
+
+	bool JobSystem::Pop(PxU32 index, Job& job)
+	{
+		Queue* queue = queues[index];
+		lock_guard<mutex> guard(queue->lock);
+		if (queue->jobs.empty())
+			return false;
+
+		job = queue->jobs.back();
+		queue->jobs.pop_back();
+		queued--;
+		return true;
+	}
+
+	bool JobSystem::Steal(PxU32 index, Job& job)
+	{
+		for (PxU32 i = 1; i < queues.size(); i++)
+		{
+			Queue* queue = queues[(index + i) % queues.size()];
+			lock_guard<mutex> guard(queue->lock);
+			if (!queue->jobs.empty())
+			{
+				job = queue->jobs.front();
+				queue->jobs.pop_front();
+				queued--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void JobSystem::Execute(Job& job)
+	{
+		if (job.task)
+		{
+			job.task->run();
+			job.task->release();
+		}
+		else
+		{
+			job.function();
+		}
+
+		if (job.counter)
+			job.counter->pending--;
+	}
+
+	PxU32 JobSystem::QueueIndex() const
+	{
+		if (current_system == this)
+			return current_queue;
+		else
+			return (PxU32)queues.size() - 1;
+	}
+}
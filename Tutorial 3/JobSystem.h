@@ -0,0 +1,91 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace PhysicsEngine
+{
+	using namespace physx;
+
+	///Counts the outstanding jobs of a group, see JobSystem::Wait
+	class JobCounter
+	{
+		friend class JobSystem;
+		std::atomic<PxU32> pending;
+
+	public:
+		JobCounter() : pending(0) {}
+
+		///True when all the jobs of the group have finished
+		bool Done() const { return pending.load() == 0; }
+	};
+
+	///Work-stealing job system.
+	///Runs PhysX tasks (as a PxCpuDispatcher) and application jobs on the same pool of threads.
+	///Every worker owns a deque: it takes its own work from the back and steals from the front of the others.
+	///Jobs submitted from other threads go to a shared deque that all workers steal from.
+	class JobSystem : public PxCpuDispatcher
+	{
+		struct Job
+		{
+			PxBaseTask* task;
+			std::function<void()> function;
+			JobCounter* counter;
+
+			Job() : task(0), counter(0) {}
+		};
+
+		struct Queue
+		{
+			std::deque<Job> jobs;
+			std::mutex lock;
+		};
+
+		std::vector<std::thread> threads;
+		//one queue per worker plus the shared queue for external threads (the last one)
+		std::vector<Queue*> queues;
+		std::atomic<PxU32> queued;
+		std::atomic<bool> running;
+		std::mutex sleep_lock;
+		std::condition_variable wake;
+
+		void WorkerMain(PxU32 index, PxU32 affinity_mask);
+
+		void Push(Job& job);
+
+		bool Pop(PxU32 index, Job& job);
+
+		bool Steal(PxU32 index, Job& job);
+
+		void Execute(Job& job);
+
+		//queue used by the calling thread
+		PxU32 QueueIndex() const;
+
+	public:
+		///Create a job system with the given number of workers and optional affinity mask per worker (repeated if there are fewer masks than workers)
+		JobSystem(PxU32 num_threads, const std::vector<PxU32>& affinity_masks=std::vector<PxU32>());
+
+		~JobSystem();
+
+		///PxCpuDispatcher interface
+		virtual void submitTask(PxBaseTask& task);
+
+		virtual PxU32 getWorkerCount() const;
+
+		///Submit an application job, optionally counted by the counter
+		void Submit(const std::function<void()>& function, JobCounter* counter=0);
+
+		///Wait for all jobs counted by the counter, running other jobs in the meantime
+		void Wait(JobCounter& counter);
+
+		///Split [0,count) into chunks of at least grain items, run them in parallel and wait for all of them
+		void ParallelFor(PxU32 count, const std::function<void(PxU32 begin, PxU32 end)>& body, PxU32 grain=1);
+	};
+}
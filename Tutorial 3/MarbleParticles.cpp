@@ -0,0 +1,109 @@
+#include "MarbleParticles.h"
+
+namespace PhysicsEngine
+{
+	using namespace std;
+
+	MarbleParticles::MarbleParticles(const MarbleParticlesDesc& _desc, PxMaterial* material)
+		: desc(_desc), index_pool(0), clock(0.f), flying(0)
+	{
+		PxParticleSystem* system = GetPhysics()->createParticleSystem(desc.capacity);
+		if (!system)
+			throw new Exception("MarbleParticles::MarbleParticles, could not create the particle system.");
+
+		//the offsets and the motion limit cannot be changed once the system is in a scene
+		system->setRestOffset(desc.radius);
+		system->setContactOffset(2.f * desc.radius);
+		system->setMaxMotionDistance(desc.max_motion);
+
+		mass = desc.density * 4.f / 3.f * PxPi * desc.radius * desc.radius * desc.radius;
+		system->setParticleMass(mass);
+		system->setRestitution(material->getRestitution());
+		system->setDynamicFriction(material->getDynamicFriction());
+
+		//the marbles push the dominoes, not only bounce off them
+		system->setParticleBaseFlag(PxParticleBaseFlag::eCOLLISION_WITH_DYNAMIC_ACTORS, true);
+		system->setParticleBaseFlag(PxParticleBaseFlag::eCOLLISION_TWOWAY, true);
+
+		index_pool = PxParticleExt::createIndexPool(desc.capacity);
+		fire_times.resize(desc.capacity, 0.f);
+
+		actor = system;
+		colors.push_back(default_color);
+		actor->userData = new UserData(&colors.back());
+	}
+
+	MarbleParticles::~MarbleParticles()
+	{
+		delete (UserData*)actor->userData;
+		index_pool->release();
+	}
+
+	PxU32 MarbleParticles::Fire(const PxVec3* positions, PxU32 count, const PxVec3& velocity)
+	{
+		count = PxMin(count, desc.capacity - flying);
+		if (!count)
+			return 0;
+
+		indices.resize(count);
+		count = index_pool->allocateIndices(count, PxStrideIterator<PxU32>(indices.data()));
+		velocities.assign(count, velocity);
+		for (PxU32 i = 0; i < count; i++)
+			fire_times[indices[i]] = clock;
+
+		PxParticleCreationData creation;
+		creation.numParticles = count;
+		creation.indexBuffer = PxStrideIterator<const PxU32>(indices.data());
+		creation.positionBuffer = PxStrideIterator<const PxVec3>(positions);
+		creation.velocityBuffer = PxStrideIterator<const PxVec3>(velocities.data());
+		if (!((PxParticleSystem*)actor)->createParticles(creation))
+		{
+			index_pool->freeIndices(count, PxStrideIterator<const PxU32>(indices.data()));
+			return 0;
+		}
+
+		flying += count;
+		return count;
+	}
+
+	void MarbleParticles::Despawn(const vector<PxU32>& despawned)
+	{
+		if (despawned.empty())
+			return;
+
+		((PxParticleSystem*)actor)->releaseParticles((PxU32)despawned.size(), PxStrideIterator<const PxU32>(despawned.data()));
+		index_pool->freeIndices((PxU32)despawned.size(), PxStrideIterator<const PxU32>(despawned.data()));
+		flying -= (PxU32)despawned.size();
+	}
+
+	void MarbleParticles::Update(PxReal dt)
+	{
+		clock += dt;
+		if (!flying)
+			return;
+
+		PxParticleReadData* data = ((PxParticleSystem*)actor)->lockParticleReadData(PxDataAccessFlag::eREADABLE);
+		if (!data)
+			return;
+
+		//the particles cannot be released while their data is locked
+		indices.clear();
+		PxStrideIterator<const PxParticleFlags> flags(data->flagsBuffer);
+		PxStrideIterator<const PxVec3> positions(data->positionBuffer);
+		for (PxU32 i = 0; i < data->validParticleRange; i++)
+		{
+			if ((flags[i] & PxParticleFlag::eVALID) && ((clock - fire_times[i] > desc.lifetime) || (positions[i].y < desc.min_height)))
+				indices.push_back(i);
+		}
+		data->unlock();
+
+		Despawn(indices);
+	}
+
+	void MarbleParticles::Reset()
+	{
+		((PxParticleSystem*)actor)->releaseParticles();
+		index_pool->freeIndices();
+		flying = 0;
+	}
+}
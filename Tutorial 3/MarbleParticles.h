@@ -0,0 +1,67 @@
+#pragma once
+
+#include "PhysicsEngine.h"
+#include <vector>
+
+namespace PhysicsEngine
+{
+	///Settings of the particle marbles
+	struct MarbleParticlesDesc
+	{
+		//particles allocated up front, a volley larger than the free room is cut short
+		PxU32 capacity;
+		PxReal radius;
+		PxReal density;
+		//seconds in flight before a marble is released, also once it falls below min_height
+		PxReal lifetime;
+		PxReal min_height;
+		//furthest a marble moves in a step, faster ones are slowed down: a fired marble covers about .37 m in a step at 60 Hz
+		PxReal max_motion;
+
+		MarbleParticlesDesc() : capacity(8192), radius(.013f), density(1.f), lifetime(10.f), min_height(-1.f), max_motion(.4f) {}
+	};
+
+	///Marbles simulated as the particles of a single CPU particle system (PxParticleSystem, PhysX 3.3 and 3.4 only).
+	///A particle costs far less than a rigid sphere: it does not rotate, has no contacts with the other marbles
+	///and never enters the solver, but it still pushes the dominoes it hits (two-way collisions).
+	class MarbleParticles : public Actor
+	{
+		MarbleParticlesDesc desc;
+		PxParticleExt::IndexPool* index_pool;
+		PxReal mass;
+		PxReal clock;
+		PxU32 flying;
+		//fire time of every particle index, used for the lifetime
+		std::vector<PxReal> fire_times;
+		//scratch buffers sized on first use, firing and releasing do not allocate afterwards
+		std::vector<PxU32> indices;
+		std::vector<PxVec3> velocities;
+
+		//release particles and give their indices back to the pool
+		void Despawn(const std::vector<PxU32>& despawned);
+
+	public:
+		///Create the particle system with the restitution and friction of material, the actor still has to be added to the scene
+		MarbleParticles(const MarbleParticlesDesc& _desc, PxMaterial* material);
+
+		~MarbleParticles();
+
+		///Fire count marbles from positions with a velocity, returns the number fired
+		PxU32 Fire(const PxVec3* positions, PxU32 count, const PxVec3& velocity);
+
+		///Age the marbles in flight by dt and release the spent ones
+		void Update(PxReal dt);
+
+		///Release every marble, e.g. after the scene has been restored
+		void Reset();
+
+		///Mass of a single marble
+		PxReal Mass() const { return mass; }
+
+		///Number of marbles the system can hold
+		PxU32 Capacity() const { return desc.capacity; }
+
+		///Number of marbles in flight
+		PxU32 Flying() const { return flying; }
+	};
+}
@@ -0,0 +1,219 @@
+#include "MeshCache.h"
+#include "PhysicsEngine.h"
+#include "Hash.h"
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <mutex>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace PhysicsEngine
+{
+	using namespace std;
+
+	static unordered_map<PxU64, PxConvexMesh*> convex_meshes;
+	static unordered_map<PxU64, PxTriangleMesh*> triangle_meshes;
+	static string cache_directory = "mesh_cache";
+	static MeshCacheStats stats;
+	//actors may be created from several threads
+	static mutex cache_lock;
+
+	static void AddCookingParams(Hash& hash)
+	{
+		PxCookingParams params = GetCooking()->getParams();
+		hash.Add((PxU32)PX_PHYSICS_VERSION);
+		hash.Add(params.areaTestEpsilon);
+		hash.Add(params.scale.length);
+		hash.Add(params.scale.speed);
+		hash.Add((PxU32)params.meshPreprocessParams);
+		hash.Add(params.meshWeldTolerance);
+		hash.Add(params.suppressTriangleMeshRemapTable);
+		hash.Add(params.buildTriangleAdjacencies);
+#if PX_PHYSICS_VERSION >= 0x304000 // SDK 3.4
+		hash.Add(params.planeTolerance);
+		hash.Add((PxU32)params.convexMeshCookingType);
+		hash.Add((PxU32)params.midphaseDesc.getType());
+		hash.Add(params.gaussMapLimit);
+#endif
+	}
+
+	static string CacheFile(PxU64 key, const char* extension)
+	{
+		stringstream name;
+		name << cache_directory << "/" << hex << setw(16) << setfill('0') << key << extension;
+		return name.str();
+	}
+
+	static bool LoadStream(const string& file_name, vector<PxU8>& data)
+	{
+		ifstream file(file_name.c_str(), ios::binary | ios::ate);
+		if (!file)
+			return false;
+
+		data.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read((char*)data.data(), data.size());
+		return (bool)file && data.size();
+	}
+
+	static void SaveStream(const string& file_name, const PxDefaultMemoryOutputStream& stream)
+	{
+#ifdef _WIN32
+		_mkdir(cache_directory.c_str());
+#else
+		mkdir(cache_directory.c_str(), 0755);
+#endif
+		//a failed write only means cooking again next time
+		ofstream file(file_name.c_str(), ios::binary);
+		file.write((const char*)stream.getData(), stream.getSize());
+	}
+
+	PxConvexMesh* CookConvexMesh(const PxConvexMeshDesc& mesh_desc)
+	{
+		Hash hash;
+		hash.Add("convex", 6);
+		AddCookingParams(hash);
+		hash.Add((PxU32)mesh_desc.flags);
+		hash.Add(mesh_desc.vertexLimit);
+		hash.Add(mesh_desc.points.data, mesh_desc.points.count, mesh_desc.points.stride, sizeof(PxVec3));
+		if (mesh_desc.indices.data)
+			hash.Add(mesh_desc.indices.data, mesh_desc.indices.count, mesh_desc.indices.stride, mesh_desc.indices.stride);
+		if (mesh_desc.polygons.data)
+			hash.Add(mesh_desc.polygons.data, mesh_desc.polygons.count, mesh_desc.polygons.stride, sizeof(PxHullPolygon));
+		PxU64 key = hash.Value();
+
+		lock_guard<mutex> guard(cache_lock);
+
+		unordered_map<PxU64, PxConvexMesh*>::iterator it = convex_meshes.find(key);
+		if (it != convex_meshes.end())
+		{
+			stats.memory_hits++;
+			return it->second;
+		}
+
+		PxConvexMesh* mesh = 0;
+		string file_name = CacheFile(key, ".cvx");
+		vector<PxU8> data;
+
+		if (cache_directory.size() && LoadStream(file_name, data))
+		{
+			PxDefaultMemoryInputData input(data.data(), (PxU32)data.size());
+			mesh = GetPhysics()->createConvexMesh(input);
+			if (mesh)
+				stats.disk_hits++;
+		}
+
+		if (!mesh)
+		{
+			PxDefaultMemoryOutputStream stream;
+
+			if (!GetCooking()->cookConvexMesh(mesh_desc, stream))
+				throw new Exception("PhysicsEngine::CookConvexMesh, cooking failed.");
+
+			PxDefaultMemoryInputData input(stream.getData(), stream.getSize());
+			mesh = GetPhysics()->createConvexMesh(input);
+			if (!mesh)
+				throw new Exception("PhysicsEngine::CookConvexMesh, could not create the mesh.");
+
+			stats.misses++;
+			if (cache_directory.size())
+				SaveStream(file_name, stream);
+		}
+
+		convex_meshes[key] = mesh;
+		return mesh;
+	}
+
+	PxTriangleMesh* CookTriangleMesh(const PxTriangleMeshDesc& mesh_desc)
+	{
+		bool indices_16bit = mesh_desc.flags.isSet(PxMeshFlag::e16_BIT_INDICES);
+
+		Hash hash;
+		hash.Add("triangle", 8);
+		AddCookingParams(hash);
+		hash.Add((PxU32)mesh_desc.flags);
+		hash.Add(mesh_desc.points.data, mesh_desc.points.count, mesh_desc.points.stride, sizeof(PxVec3));
+		hash.Add(mesh_desc.triangles.data, mesh_desc.triangles.count, mesh_desc.triangles.stride, indices_16bit ? 3*sizeof(PxU16) : 3*sizeof(PxU32));
+		if (mesh_desc.materialIndices.data)
+			hash.Add(mesh_desc.materialIndices.data, mesh_desc.triangles.count, mesh_desc.materialIndices.stride, sizeof(PxMaterialTableIndex));
+		PxU64 key = hash.Value();
+
+		lock_guard<mutex> guard(cache_lock);
+
+		unordered_map<PxU64, PxTriangleMesh*>::iterator it = triangle_meshes.find(key);
+		if (it != triangle_meshes.end())
+		{
+			stats.memory_hits++;
+			return it->second;
+		}
+
+		PxTriangleMesh* mesh = 0;
+		string file_name = CacheFile(key, ".tri");
+		vector<PxU8> data;
+
+		if (cache_directory.size() && LoadStream(file_name, data))
+		{
+			PxDefaultMemoryInputData input(data.data(), (PxU32)data.size());
+			mesh = GetPhysics()->createTriangleMesh(input);
+			if (mesh)
+				stats.disk_hits++;
+		}
+
+		if (!mesh)
+		{
+			PxDefaultMemoryOutputStream stream;
+
+			if (!GetCooking()->cookTriangleMesh(mesh_desc, stream))
+				throw new Exception("PhysicsEngine::CookTriangleMesh, cooking failed.");
+
+			PxDefaultMemoryInputData input(stream.getData(), stream.getSize());
+			mesh = GetPhysics()->createTriangleMesh(input);
+			if (!mesh)
+				throw new Exception("PhysicsEngine::CookTriangleMesh, could not create the mesh.");
+
+			stats.misses++;
+			if (cache_directory.size())
+				SaveStream(file_name, stream);
+		}
+
+		triangle_meshes[key] = mesh;
+		return mesh;
+	}
+
+	void MeshCacheDirectory(const string& directory)
+	{
+		lock_guard<mutex> guard(cache_lock);
+		cache_directory = directory;
+	}
+
+	const string& MeshCacheDirectory()
+	{
+		return cache_directory;
+	}
+
+	MeshCacheStats GetMeshCacheStats()
+	{
+		lock_guard<mutex> guard(cache_lock);
+		return stats;
+	}
+
+	void ReleaseMeshCache()
+	{
+		lock_guard<mutex> guard(cache_lock);
+
+		//shapes still using a mesh keep their own reference
+		for (unordered_map<PxU64, PxConvexMesh*>::iterator it = convex_meshes.begin(); it != convex_meshes.end(); ++it)
+			it->second->release();
+		convex_meshes.clear();
+
+		for (unordered_map<PxU64, PxTriangleMesh*>::iterator it = triangle_meshes.begin(); it != triangle_meshes.end(); ++it)
+			it->second->release();
+		triangle_meshes.clear();
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+#include <string>
+
+namespace PhysicsEngine
+{
+	using namespace physx;
+
+	///Counters of the cooked mesh cache
+	struct MeshCacheStats
+	{
+		//meshes reused from memory
+		PxU32 memory_hits;
+		//cooked streams loaded from the cache directory
+		PxU32 disk_hits;
+		//meshes cooked from scratch
+		PxU32 misses;
+
+		MeshCacheStats() : memory_hits(0), disk_hits(0), misses(0) {}
+	};
+
+	///Cook a convex mesh or reuse the one cooked from the same data and cooking parameters
+	PxConvexMesh* CookConvexMesh(const PxConvexMeshDesc& mesh_desc);
+
+	///Cook a triangle mesh or reuse the one cooked from the same data and cooking parameters
+	PxTriangleMesh* CookTriangleMesh(const PxTriangleMeshDesc& mesh_desc);
+
+	///Set the directory of the cooked streams, an empty name keeps the cache in memory only
+	void MeshCacheDirectory(const std::string& directory);
+
+	///Get the directory of the cooked streams
+	const std::string& MeshCacheDirectory();
+
+	///Get the cache counters
+	MeshCacheStats GetMeshCacheStats();
+
+	///Release the cached meshes, called by PxRelease
+	void ReleaseMeshCache();
+}
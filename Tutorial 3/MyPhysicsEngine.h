@@ -1,8 +1,20 @@
 #pragma once
 
 #include "BasicActors.h"
+#include "SettleCache.h"
+#include "FloorBuilder.h"
+#include "ProjectilePool.h"
+#include "MarbleParticles.h"
+#include "CourseFile.h"
+#include "CourseSegments.h"
+#include "CourseGenerator.h"
+#include "Hash.h"
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
 
 namespace PhysicsEngine
 {
@@ -18,6 +30,30 @@ namespace PhysicsEngine
 	//vertices have to be specified in a counter-clockwise order to assure the correct shading in rendering
 	static PxU32 pyramid_trigs[] = {1, 4, 0, 3, 1, 0, 2, 3, 0, 4, 2, 0, 3, 2, 1, 2, 4, 1};
 
+	//the built-in course
+	static const CourseSegment default_course[] = {
+		CourseSegment(SEGMENT_LINE, 50, 1.98f),
+		CourseSegment(SEGMENT_CORNER, 25, PxPiDivTwo),
+		CourseSegment(SEGMENT_STAIRS_UP, 50),
+		CourseSegment(SEGMENT_LINE, 50, 1.98f),
+		CourseSegment(SEGMENT_CORNER, 25, PxPiDivTwo),
+		CourseSegment(SEGMENT_LINE, 5, 1.90f),
+		CourseSegment(SEGMENT_HEIGHT, 0, 0.05f),
+		CourseSegment(SEGMENT_CORNER, 25, PxPiDivTwo),
+		CourseSegment(SEGMENT_STAIRS_UP, 50),
+		CourseSegment(SEGMENT_CORNER, 25, -PxPiDivTwo),
+		CourseSegment(SEGMENT_STAIRS_UP, 50),
+		CourseSegment(SEGMENT_CORNER, 25, -PxPiDivTwo),
+		CourseSegment(SEGMENT_STAIRS_UP, 50),
+		CourseSegment(SEGMENT_HEIGHT, 0, 0.05f),
+		CourseSegment(SEGMENT_STAIRS_UP, 50),
+		CourseSegment(SEGMENT_STAIRS_DOWN, 25),
+		CourseSegment(SEGMENT_CORNER, 25, -PxPiDivTwo),
+		CourseSegment(SEGMENT_LINE, 5, 1.9f),
+		CourseSegment(SEGMENT_HEIGHT, 0, 0.05f),
+		CourseSegment(SEGMENT_LINE, 100, 1.98f)
+	};
+
 	class Pyramid : public ConvexMesh
 	{
 	public:
@@ -36,6 +72,20 @@ namespace PhysicsEngine
 		}
 	};
 
+	//domino half-extents
+	static const PxVec3 domino_size = PxVec3(0.0254f, 0.0508f, 0.009525f);
+
+	///A domino, all dominoes with the same material share a single shape
+	class Domino : public DynamicActor
+	{
+	public:
+		Domino(const PxTransform& pose, PxMaterial* material, PxReal density=1.f)
+			: DynamicActor(pose)
+		{
+			AttachShape(GetSharedShape(PxBoxGeometry(domino_size), material), density);
+		}
+	};
+
 	struct FilterGroup
 	{
 		enum Enum
@@ -92,6 +142,8 @@ namespace PhysicsEngine
 		//an example variable that will be checked in the main simulation loop
 		bool trigger;
 		Scene* scene;
+		//actors put to sleep by the last step, for the actors with eSEND_SLEEP_NOTIFIES
+		vector<PxActor*> asleep;
 
 		MySimulationEventCallback(Scene* sceneI) : trigger(false) {
 			scene = sceneI;
@@ -139,7 +191,10 @@ namespace PhysicsEngine
 
 		virtual void onConstraintBreak(PxConstraintInfo* constraints, PxU32 count) {}
 		virtual void onWake(PxActor** actors, PxU32 count) {}
-		virtual void onSleep(PxActor** actors, PxU32 count) {}
+		virtual void onSleep(PxActor** actors, PxU32 count)
+		{
+			asleep.insert(asleep.end(), actors, actors + count);
+		}
 #if PX_PHYSICS_VERSION >= 0x304000
 		virtual void onAdvance(const PxRigidBody* const* bodyBuffer, const PxTransform* poseBuffer, const PxU32 count) {}
 #endif
@@ -158,9 +213,14 @@ namespace PhysicsEngine
 		}
 
 		pairFlags = PxPairFlag::eCONTACT_DEFAULT;
-		//enable continous collision detection
-//		pairFlags |= PxPairFlag::eCCD_LINEAR;
-		
+		//enable continous collision detection for the shapes that ask for it (FilterFlag::CCD),
+		//the scene has to be created with CCD enabled
+		if ((filterData0.word2 | filterData1.word2) & FilterFlag::CCD)
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			pairFlags |= PxPairFlag::eCCD_LINEAR;
+#else
+			pairFlags |= PxPairFlag::eDETECT_CCD_CONTACT;
+#endif
 		
 		//customise collision filtering here
 		//e.g.
@@ -181,24 +241,160 @@ namespace PhysicsEngine
 	///Custom scene class
 	class MyScene : public Scene
 	{
-		vector<Actor*> bullets, bullets2;
+		//marbles fired from the camera, created with the course and reused
+		ProjectilePool projectiles;
+		ProjectilePoolDesc projectile_desc;
+		//the same marbles as particles, for volleys far larger than the pool
+		MarbleParticles* particles;
+		MarbleParticlesDesc particle_desc;
+		PxU32 marble_mode;
+		//marble positions of the volley being fired
+		vector<PxVec3> volley_positions;
 		Pyramid* pyramid;
 		Cloth* cloth;
 		Plane* plane;
-		Sphere* marble;
 		Hammer* hammer;
-		Box* box, box2;
+		Domino* box;
+		Box box2;
 		SBox* staticBox;
 		MySimulationEventCallback* my_callback;
 		PxMaterial* dominoMat;
+		PxVec3 dominoColor;
+		PxMaterial* glassMat;
 		RevoluteJoint* hamJoint;
 		DistanceJoint* distJoint;
-		bool isDone, currentList;
+		bool isDone;
+		//all dominoes in the order of the course, without the ones lost out of bounds
+		vector<Actor*> dominoes;
+		unordered_map<PxActor*, PxU32> domino_index;
+		//all dominoes as built, a reset brings back the lost ones
+		vector<Actor*> course_order;
+		//course indices of the moving dominoes, captured before each step for the wave tracker
+		vector<PxU32> moving_dominoes;
+		//topple wave state, written by the wave tracker task
+		PxU32 wave_frontier, wave_moving, wave_peak;
+		string wave_text;
+		//course building runs in two phases: the spawners lay out the segments (domino poses and platforms),
+		//then CreateSegments creates their actors on worker threads and adds them to the scene in course order
+		struct SegmentLayout
+		{
+			vector<PxTransform> poses;
+			PxMaterial* material;
+			PxVec3 color;
+			FloorBuilder floor;
+			//dominoes then platforms, created by CreateSegments
+			vector<Actor*> actors;
+		};
+		vector<SegmentLayout> layouts;
+		//segment being laid out, closed by AddSegment
+		SegmentLayout layout;
+		//local poses of the segment being laid out
+		vector<LocalPose> local_poses;
+		//segments of the course as built, kept for ReloadCourse
+		struct LiveSegment
+		{
+			CourseSegment segment;
+			CourseMaterial material;
+			PxVec3 color;
+			//where the segment starts and where the next one starts
+			PxTransform start, end;
+			//layouts of the segment while it is being spawned
+			PxU32 layout_count;
+			vector<Actor*> dominoes;
+			//dominoes and platforms
+			vector<Actor*> actors;
+		};
+		vector<LiveSegment> live_segments;
+		PxTransform course_start;
+		FloorBuilder::FloorType floor_type;
+		//course file read by CustomInit, the built-in course if empty
+		string course_file;
+		//generated course used instead of the file
+		bool generate;
+		CourseGeneratorDesc generator;
+		//start the course with the dominoes asleep at their rest poses
+		bool settle;
+		//activation manager: dominoes ahead of the wave wait in a grid of activation_distance cells (xz)
+		//until a moving actor gets close
+		PxU32 activation_mode;
+		PxReal activation_distance;
+		unordered_map<PxU64, vector<PxU32>> waiting_cells;
+		vector<bool> waiting;
+		PxU32 activated;
+		//toppled dominoes at rest are merged into one static per segment
+		bool freeze;
+		unordered_map<PxU32, PxRigidStatic*> frozen_segments;
+		//segment of every domino, so the merge does not depend on the aggregates
+		unordered_map<PxActor*, PxU32> domino_segment;
+		PxU32 frozen_dominoes;
+		//overlap check of the spawned dominoes and its results
+		PxU32 validation_mode;
+		PxU32 overlaps_found, overlaps_left, overlaps_corrected;
+		PxReal max_penetration;
 		
 	public:
+		///How the dominoes ahead of the topple wave are kept out of the solver
+		enum ActivationMode
+		{
+			ACTIVATION_OFF,
+			//asleep until the wave gets close, put back to sleep if woken before
+			ACTIVATION_SLEEP,
+			//kinematic until the wave gets close, no solver work at all
+			ACTIVATION_KINEMATIC
+		};
+
+		//how far ahead a moving actor reaches: its speed over this time is added to the activation distance
+		static constexpr PxReal ACTIVATION_LOOKAHEAD = .1f;
+
+		//a domino tilted more than 45 degrees counts as toppled
+		static constexpr PxReal TOPPLED_UP = .7071f;
+
+		//a loaded course saved without aggregates has no segments, its dominoes are merged per cell of this size (xz)
+		static constexpr PxReal FREEZE_CELL = 2.f;
+
+		///What the overlap check does with penetrating dominoes after the course is built
+		enum ValidationMode
+		{
+			VALIDATION_OFF,
+			//count them and measure the deepest penetration
+			VALIDATION_REPORT,
+			//move them out of the shapes they penetrate, then check again
+			VALIDATION_CORRECT
+		};
+
+		//correction passes of the overlap check, pushing a domino out may push it into another one
+		static const PxU32 VALIDATION_PASSES = 4;
+
+		//dominoes created at a time while a course is built, only the layouts of one batch are held in memory
+		static const PxU32 SPAWN_BATCH_DOMINOES = 4096;
+
+		//marbles fired at a time
+		static const PxU32 VOLLEY_SIZE = 10;
+
+		//impulse of a fired marble, about 20 m/s
+		static constexpr PxReal MARBLE_IMPULSE = .0002f;
+
+		///How the fired marbles are simulated
+		enum MarbleMode
+		{
+			//rigid spheres of the projectile pool
+			MARBLES_RIGID,
+			//particles of a single particle system, no contacts between the marbles
+			MARBLES_PARTICLES
+		};
+
+		//particle marbles fired at a time, a square of 32 by 32
+		static const PxU32 PARTICLE_VOLLEY = 1024;
+
 		//specify your custom filter shader here
-		//PxDefaultSimulationFilterShader by default
-		MyScene() : Scene() {};
+		//PxDefaultSimulationFilterShader by default, CustomFilterShader adds CCD for the marbles
+		MyScene() : Scene(CustomFilterShader), generate(false), settle(false), activation_mode(ACTIVATION_OFF), activation_distance(.5f), activated(0),
+			freeze(false), frozen_dominoes(0), validation_mode(VALIDATION_OFF), overlaps_found(0), overlaps_left(0), overlaps_corrected(0),
+			max_penetration(0.f), floor_type(FloorBuilder::FLOOR_MESH), particles(0), marble_mode(MARBLES_RIGID)
+		{
+			//the course is long and thin, multi-box pruning suits it better than sweep-and-prune
+			BroadPhase(PxBroadPhaseType::eMBP);
+		};
 
 		///A custom scene class
 		void SetVisualisation()
@@ -207,34 +403,61 @@ namespace PhysicsEngine
 			px_scene->setVisualizationParameter(PxVisualizationParameter::eCOLLISION_SHAPES, 1.0f);
 		}
 
-		//Custom scene initialisation
-		virtual void CustomInit() 
+		//Scene state shared by a built and a loaded course
+		void InitRunState()
 		{
-			SetVisualisation();			
+			SetVisualisation();
+
+			isDone = false;
+
+			projectiles.Clear();
+			particles = 0;
+			dominoes.clear();
+			domino_index.clear();
+			course_order.clear();
+			domino_segment.clear();
+			wave_frontier = wave_moving = wave_peak = 0;
+			wave_text = "";
+			frozen_segments.clear();
+			frozen_dominoes = 0;
+
+			//follow the topple wave while the solver runs
+			AddStepTask("MyScene::TrackWave", [this]() { TrackWave(); });
 
 			GetMaterial()->setDynamicFriction(.2f);
 
 			///Initialise and set the customised event callback
 
 			dominoMat = CreateMaterial(0.2f, 0.2f, 0.6f);
+			glassMat = CreateMaterial(0.9f, 0.4f, .658f);
 
 			my_callback = new MySimulationEventCallback(this);
 			px_scene->setSimulationEventCallback(my_callback);
+		}
+
+		//Custom scene initialisation
+		virtual void CustomInit() 
+		{
+			InitRunState();
 
 			plane = new Plane();
 			plane->Color(PxVec3(210.f/255.f,210.f/255.f,210.f/255.f));
 			Add(plane);
 
-			hammer = new Hammer(PxTransform(PxVec3(5.f, 1.5f, 1.5f)), 1.f, 2.f); //Creating an object of type "Hammer" as defined in BasicActors.h
+			CourseReader* course = CreateCourse(course_file, generate ? &generator : 0);
+			PxTransform start = course->Info().start;
+
+			hammer = new Hammer(PxTransform(start.transform(PxVec3(0.f, 1.5f, -.5f)), start.q), 1.f, 2.f); //Creating an object of type "Hammer" as defined in BasicActors.h, just behind the start of the course
 			hammer->Color(PxVec3(0.f, 0.f, 0.f));
+			hammer->Name("Hammer");
 			PxRigidDynamic* px_actor = (PxRigidDynamic*)hammer->Get();
 			px_actor->setAngularDamping(10.0f); //Applying angular damping to ensure that the hammer won't freely swing for too long
 			px_actor->setSleepThreshold(0.f); //Ensure the hammer will not go to sleep automatically, which stops the joint's motor from moving the hammer
 			
 			hamJoint = new RevoluteJoint(NULL,
-				PxTransform(PxVec3(5.f, 1.423f, 1.5f), PxQuat(PxPi * 2, PxVec3(1.f, 0.f, 0.f))),
+				PxTransform(start.transform(PxVec3(0.f, 1.423f, -.5f)), start.q * PxQuat(PxPi * 2, PxVec3(1.f, 0.f, 0.f))),
 				hammer, 
-				PxTransform(PxVec3(0.0f, 1.15f, 0.f))); //Connecting the hammer at local position 0, 1.15, 0 to the world position 5, 1.423, 1.5
+				PxTransform(PxVec3(0.0f, 1.15f, 0.f))); //Connecting the hammer at local position 0, 1.15, 0 to the world, 1.423 above and 0.5 behind the start
 			hamJoint->DriveVelocity(-1.f); //Setting the maximum power of the drive to be used on the user pressing H
 
 			Add(hammer);
@@ -255,310 +478,988 @@ namespace PhysicsEngine
 			RevoluteJoint joint(box, PxTransform(PxVec3(0.f,0.f,0.f),PxQuat(PxPi/2,PxVec3(0.f,1.f,0.f))), box2, PxTransform(PxVec3(0.f,5.f,0.f)));
 			*/
 
-			PxTransform startLoc = PxTransform(PxVec3(5.f, 0.f, 2.f), PxQuat(PxPi * 2, PxVec3(0.f, 1.f, 0.f)));
-
-			//PxTransform temp = startLoc;
-
-
-			startLoc = spawnLine(startLoc, 50, 1.98f);
-			startLoc = spawnCorner(startLoc, 25, PxPiDivTwo);
-			startLoc = spawnStairs(startLoc, 50);
-			startLoc = spawnLine(startLoc, 50, 1.98f);
-			startLoc = spawnCorner(startLoc, 25, PxPiDivTwo);
-			startLoc = spawnLine(startLoc, 5, 1.90f);
-			startLoc.p.y = 0.05f;
-			startLoc = spawnCorner(startLoc, 25, PxPiDivTwo);
-			startLoc = spawnStairs(startLoc, 50);
-			startLoc = spawnCorner(startLoc, 25, -PxPiDivTwo);
-			startLoc = spawnStairs(startLoc, 50);
-			startLoc = spawnCorner(startLoc, 25, -PxPiDivTwo);
-			startLoc = spawnStairs(startLoc, 50);
-			startLoc.p.y = 0.05f;
-			startLoc = spawnStairs(startLoc, 50);
-			startLoc = spawnStairs(startLoc, 25, true);
-			startLoc = spawnCorner(startLoc, 25, -PxPiDivTwo);
-			startLoc = spawnLine(startLoc, 5, 1.9f);
-			startLoc.p.y = 0.05f;
-			startLoc = spawnLine(startLoc, 100, 1.98f);
-			box->Name("LastDomino"); //Setting the last domino to be spawned to have the name "LastDomino" which will be filtered for
+			PxTransform startLoc;
+			try {
+				startLoc = BuildCourse(*course);
+			}
+			catch (Exception*) {
+				delete course;
+				throw;
+			}
+			delete course;
 
 			staticBox = new SBox(startLoc, PxVec3(0.0254f, 0.0508f, 0.009525f)); //Spawn a static trigger box at the end of the domino run
 			staticBox->SetTrigger(true, 0); //Setting the static box to be a trigger
 			staticBox->Name("TriggerBox");
 			Add(staticBox);
 
-			startLoc.p.y += 4.f;
-			cloth = new Cloth(startLoc, PxVec2(4.f, 4.f), 20, 20, true);
-			Add(cloth);
-			
+			spawnCloth(startLoc);
+
+			//the marbles wait out of the simulation under the start of the course, swept by CCD if the scene has it
+			ProjectilePoolDesc pool = projectile_desc;
+			pool.ccd = pool.ccd && CCD();
+			AddBatch(projectiles.Create(pool, glassMat, color_palette[0], PxTransform(start.transform(PxVec3(0.f, -10.f, 0.f)))));
+			spawnParticles();
 		}
 
-		//Custom udpate function
-		virtual void CustomUpdate(bool amIDone)
+		//Custom initialisation of a saved course: rebind the roles of the loaded actors by their names
+		virtual void CustomLoad()
 		{
-			if (amIDone == true) {
-				isDone = amIDone;
+			InitRunState();
+
+			//the segments are not saved: the aggregates stand in for them, else cells of the course
+			unordered_map<PxAggregate*, PxU32> aggregate_segments;
+			unordered_map<PxU64, PxU32> cell_segments;
+			const vector<Actor*>& actors = Actors();
+			for (unsigned int i = 0; i < actors.size(); i++) {
+				string name = actors[i]->Name();
+				if (name == "Domino" || name == "LastDomino") {
+					PxRigidActor* actor = (PxRigidActor*)actors[i]->Get();
+					PxU32 segment = (PxU32)(aggregate_segments.size() + cell_segments.size());
+					if (actor->getAggregate())
+						segment = aggregate_segments.insert(make_pair(actor->getAggregate(), segment)).first->second;
+					else {
+						PxVec3 position = actor->getGlobalPose().p;
+						PxU64 cell = ((PxU64)(PxU32)(PxI32)PxFloor(position.x / FREEZE_CELL) << 32) | (PxU32)(PxI32)PxFloor(position.z / FREEZE_CELL);
+						segment = cell_segments.insert(make_pair(cell, segment)).first->second;
+					}
+					AddDomino(actors[i], segment);
+				}
+				else if (name == "TriggerBox")
+					spawnCloth(((PxRigidActor*)actors[i]->Get())->getGlobalPose());
+				else if (name == "Bullet")
+					projectiles.Adopt(projectile_desc, actors[i]);
+			}
+			spawnParticles();
+
+			//the hammer is the only revolute joint of the course
+			vector<PxJoint*> joints = GetAllJoints();
+			for (unsigned int i = 0; i < joints.size(); i++) {
+				if (joints[i]->getConcreteType() == PxJointConcreteType::eREVOLUTE)
+					hamJoint = new RevoluteJoint((PxRevoluteJoint*)joints[i]);
+			}
+		}
+
+		//Custom settling: rest poses first, then the dominoes ahead of the wave are parked
+		virtual void CustomSettle()
+		{
+			if (validation_mode != VALIDATION_OFF)
+				ValidateCourse();
+
+			if (settle && !dominoes.empty())
+				SettleDominoes();
+
+			InitActivation();
+		}
+
+		//Look for dominoes spawned into each other or into the floors and optionally push them out
+		void ValidateCourse()
+		{
+			vector<PxRigidActor*> actors(dominoes.size());
+			for (unsigned int i = 0; i < dominoes.size(); i++)
+				actors[i] = (PxRigidActor*)dominoes[i]->Get();
+
+			vector<Overlap> overlaps = FindOverlaps(actors);
+			overlaps_found = (PxU32)overlaps.size();
+			max_penetration = 0.f;
+			for (unsigned int i = 0; i < overlaps.size(); i++)
+				max_penetration = PxMax(max_penetration, overlaps[i].depth);
+
+			unordered_set<PxRigidActor*> corrected;
+			for (PxU32 pass = 0; (validation_mode == VALIDATION_CORRECT) && (pass < VALIDATION_PASSES) && !overlaps.empty(); pass++) {
+				for (unsigned int i = 0; i < overlaps.size(); i++) {
+					PxRigidActor* actor = overlaps[i].actor;
+					PxTransform pose = actor->getGlobalPose();
+					pose.p += overlaps[i].direction * overlaps[i].depth;
+					actor->setGlobalPose(pose);
+					corrected.insert(actor);
+				}
+				overlaps = FindOverlaps(actors);
 			}
+
+			overlaps_corrected = (PxU32)corrected.size();
+			overlaps_left = (PxU32)overlaps.size();
+
+			cout << "MyScene::ValidateCourse, " << overlaps_found << " penetrations, deepest " << max_penetration * 1000.f << " mm";
+			if (validation_mode == VALIDATION_CORRECT)
+				cout << ", moved " << overlaps_corrected << " dominoes, " << overlaps_left << " left";
+			cout << endl;
 		}
 
-		PxTransform spawnLine(PxTransform startLocation, PxI16 noDominoes, float shrink) // Spawns a straight line in the forward vector of the transform passed to the function
+		//Find the rest poses of the dominoes once per course, cached on disk by the course hash
+		void SettleDominoes()
 		{
-			PxTransform temp = PxTransform(PxVec3(
-				startLocation.p.x - (startLocation.q.getBasisVector2().x * 0.0616f),
-				startLocation.p.y,
-				startLocation.p.z - (startLocation.q.getBasisVector2().z * 0.0616f)
-			));
-			for (int i = 0; i < noDominoes; i++) { // For loop to place x dominoes
-				box = new Box(PxTransform(PxVec3(
-					startLocation.p.x + (startLocation.q.getBasisVector2().x * 0.0616f * i),
-					startLocation.p.y, 
-					startLocation.p.z + (startLocation.q.getBasisVector2().z * 0.0616f * i)
-				)), PxVec3(0.0254f, 0.0508f, 0.009525f));
+			const PxReal dt = 1.f/60.f;
+			Hash hash;
+			hash.Add(CourseHash());
+			hash.Add(dt);
+
+			vector<PxTransform> poses(course_order.size());
+			if (!LoadSettledPoses(hash.Value(), poses)) {
+				//the settle pass puts back the dominoes it loses out of bounds
+				bool settled = Settle(course_order, poses, dt);
+				RestoreDominoes();
+				if (!settled) {
+					//a course that keeps moving is left as it was built
+					cerr << "MyScene::CustomSettle, the dominoes did not settle." << endl;
+					return;
+				}
+				SaveSettledPoses(hash.Value(), poses);
+			}
 
-				PxRigidDynamic* px_actor = (PxRigidDynamic*)box->Get();
-				px_actor->setGlobalPose(PxTransform(px_actor->getGlobalPose().p ,startLocation.q));
-				box->Material(dominoMat);
-				box->Color(PxVec3(1.f, 1.f, 1.f));
-				box->Name("Domino");
-				Add(box);
+			for (unsigned int i = 0; i < dominoes.size(); i++) {
+				PxRigidDynamic* actor = (PxRigidDynamic*)dominoes[i]->Get();
+				actor->setGlobalPose(poses[i], false);
+				actor->putToSleep();
 			}
+		}
+
+		///Settle the course on init
+		void SettleCourse(bool value) { settle = value; }
+
+		///Settle the course on init
+		bool SettleCourse() { return settle; }
 
-			PxRigidDynamic* px_actor = (PxRigidDynamic*)box->Get();
-			PxVec3 position = px_actor->getGlobalPose().p;
+		///Keep the dominoes further than distance from anything moving asleep or kinematic
+		void Activation(ActivationMode mode, PxReal distance=.5f)
+		{
+			if (distance <= 0.f)
+				throw new Exception("MyScene::Activation, the distance has to be positive.");
 
-			position.x = position.x + (startLocation.q.getBasisVector2().x * 0.0616f);
-			position.z = position.z + (startLocation.q.getBasisVector2().z * 0.0616f);
+			activation_mode = mode;
+			activation_distance = distance;
+		}
 
-			if (temp.p.y > 0.1f) { spawnFloor(temp, px_actor->getGlobalPose(), shrink); }
+		///Get the activation mode
+		ActivationMode Activation() { return (ActivationMode)activation_mode; }
 
-			startLocation.p = position;
+		///Number of dominoes promoted by the activation manager since init or reset
+		PxU32 ActivatedDominoes() { return activated; }
 
-			return startLocation;
+		PxI32 ActivationCoord(PxReal value)
+		{
+			return (PxI32)PxFloor(value / activation_distance);
 		}
-		// Spawnline -> Start location, number of dominoes (length of line), size of platform below floating dominoes
-		PxTransform spawnStairs(PxTransform startLocation, PxI16 noDominoes) {
 
-			for (int i = 0; i < noDominoes; i++) { // For loop to place x dominoes
+		PxU64 ActivationCell(PxI32 x, PxI32 z)
+		{
+			return ((PxU64)(PxU32)x << 32) | (PxU32)z;
+		}
+
+		//Park every domino in the scene, the first step promotes the ones next to the hammer
+		void InitActivation()
+		{
+			waiting_cells.clear();
+			waiting.assign(dominoes.size(), false);
+			activated = 0;
+			//events of the settle pass
+			my_callback->asleep.clear();
+
+			for (unsigned int i = 0; i < dominoes.size(); i++) {
+				PxRigidDynamic* actor = (PxRigidDynamic*)dominoes[i]->Get();
+				bool kinematic = actor->getRigidBodyFlags().isSet(PxRigidBodyFlag::eKINEMATIC);
+
+				if (activation_mode == ACTIVATION_OFF || !actor->getScene()) {
+					//a course saved with parked dominoes
+					if (kinematic)
+						actor->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, false);
+					continue;
+				}
 
-				PxTransform temp = PxTransform(PxVec3(
-					startLocation.p.x + (startLocation.q.getBasisVector2().x * 0.0616f * i),
-					startLocation.p.y + (startLocation.q.getBasisVector1().y * 0.0116f * i),
-					startLocation.p.z + (startLocation.q.getBasisVector2().z * 0.0616f * i)
-				), startLocation.q);
+				PxVec3 position = actor->getGlobalPose().p;
+				waiting[i] = true;
+				waiting_cells[ActivationCell(ActivationCoord(position.x), ActivationCoord(position.z))].push_back(i);
 
-				if ((temp.p.y) > 0.01f) {
-					spawnFloor(temp, temp, 2.0f);
+				if (activation_mode == ACTIVATION_KINEMATIC) {
+					if (!kinematic)
+						actor->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, true);
 				}
+				else if (kinematic) {
+					actor->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, false);
+					actor->putToSleep();
+				}
+				else
+					actor->putToSleep();
+			}
+		}
 
-				box = new Box(temp, PxVec3(0.0254f, 0.0508f, 0.009525f));
+		//Turn a waiting domino into a sleeping dynamic, a contact with the wave wakes it
+		void PromoteDomino(PxU32 index)
+		{
+			waiting[index] = false;
+			activated++;
 
-				PxRigidDynamic* px_actor = (PxRigidDynamic*)box->Get();
-				px_actor->setGlobalPose(PxTransform(px_actor->getGlobalPose().p, startLocation.q));
-				box->Material(dominoMat);
-				box->Color(PxVec3(1.f, 1.f, 1.f));
-				box->Name("Domino");
-				Add(box);
+			PxRigidDynamic* actor = (PxRigidDynamic*)dominoes[index]->Get();
+			if (actor->getRigidBodyFlags().isSet(PxRigidBodyFlag::eKINEMATIC)) {
+				actor->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, false);
+				actor->putToSleep();
 			}
+		}
 
-			PxRigidDynamic* px_actor = (PxRigidDynamic*)box->Get();
-			PxVec3 position = px_actor->getGlobalPose().p;
+		//Promote the waiting dominoes close to the actors that moved in the last step.
+		//Only the cells around the moving actors are visited, so the cost follows the width of the wave.
+		void ActivateNearWave(PxActor** active, PxU32 nb_active)
+		{
+			for (PxU32 i = 0; i < nb_active; i++) {
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+				if (!active[i]->isRigidDynamic())
+#else
+				if (!active[i]->is<PxRigidDynamic>())
+#endif
+					continue;
+
+				//a waiting domino woken up on its own is not part of the wave
+				unordered_map<PxActor*, PxU32>::const_iterator it = domino_index.find(active[i]);
+				if (it != domino_index.end() && waiting[it->second])
+					continue;
+
+				PxRigidDynamic* actor = (PxRigidDynamic*)active[i];
+				PxVec3 position = actor->getGlobalPose().p;
+				PxReal reach = activation_distance + actor->getLinearVelocity().magnitude() * ACTIVATION_LOOKAHEAD;
+				PxI32 cells = (PxI32)PxCeil(reach / activation_distance);
+				PxI32 cell_x = ActivationCoord(position.x);
+				PxI32 cell_z = ActivationCoord(position.z);
+
+				for (PxI32 x = cell_x - cells; x <= cell_x + cells; x++) {
+					for (PxI32 z = cell_z - cells; z <= cell_z + cells; z++) {
+						unordered_map<PxU64, vector<PxU32>>::iterator cell = waiting_cells.find(ActivationCell(x, z));
+						if (cell == waiting_cells.end())
+							continue;
+
+						vector<PxU32>& indices = cell->second;
+						for (unsigned int j = 0; j < indices.size();) {
+							PxVec3 domino = ((PxRigidActor*)dominoes[indices[j]]->Get())->getGlobalPose().p;
+							if ((domino - position).magnitudeSquared() <= reach * reach) {
+								PromoteDomino(indices[j]);
+								indices[j] = indices.back();
+								indices.pop_back();
+							}
+							else
+								j++;
+						}
+
+						if (indices.empty())
+							waiting_cells.erase(cell);
+					}
+				}
+			}
 
-			position.x = position.x + (startLocation.q.getBasisVector2().x * 0.0616f);
-			position.y = position.y + (startLocation.q.getBasisVector1().y * 0.0116f);
-			position.z = position.z + (startLocation.q.getBasisVector2().z * 0.0616f);
+			//whatever is still waiting goes back to sleep
+			if (activation_mode == ACTIVATION_SLEEP) {
+				for (PxU32 i = 0; i < nb_active; i++) {
+					unordered_map<PxActor*, PxU32>::const_iterator it = domino_index.find(active[i]);
+					if (it != domino_index.end() && waiting[it->second])
+						((PxRigidDynamic*)active[i])->putToSleep();
+				}
+			}
+		}
 
-			startLocation.p = position;
+		///Built-in course
+		static CourseReader* DefaultCourse()
+		{
+			CourseInfo info;
+			info.start = PxTransform(PxVec3(5.f, 0.f, 2.f), PxQuat(PxPi * 2, PxVec3(0.f, 1.f, 0.f)));
+			info.materials.push_back(CourseMaterial{ .2f, .2f, .6f });
+			info.colors.push_back(PxVec3(1.f, 1.f, 1.f));
+			return new ArrayCourseReader(info, default_course, sizeof(default_course) / sizeof(default_course[0]));
+		}
 
-			return startLocation;
+		///Open a generated course, else the course file, else the built-in course
+		static CourseReader* CreateCourse(const string& file_name, const CourseGeneratorDesc* generator_desc=0)
+		{
+			if (generator_desc)
+				return new CourseGenerator(*generator_desc);
+			return file_name.size() ? OpenCourse(file_name) : DefaultCourse();
 		}
-		// Spawnstairs -> Start location, number of dominoes (length of line)
-		PxTransform spawnStairs(PxTransform startLocation, PxI16 noDominoes, bool forDown) {
 
-			for (int i = 0; i < noDominoes; i++) { // For loop to place x dominoes
+		///Set the course file read by the next Init, the built-in course if empty
+		void Course(const string& file_name) { course_file = file_name; generate = false; }
 
-				PxTransform temp = PxTransform(PxVec3(
-					startLocation.p.x + (startLocation.q.getBasisVector2().x * 0.0616f * i),
-					startLocation.p.y - (startLocation.q.getBasisVector1().y * 0.0116f * i),
-					startLocation.p.z + (startLocation.q.getBasisVector2().z * 0.0616f * i)
-				), startLocation.q);
+		///Generate the course of the next Init
+		void Course(const CourseGeneratorDesc& desc) { generator = desc; generate = true; }
 
-				if ((temp.p.y) > 0.01f) {
-					spawnFloor(temp, temp, 2.0f);
+		///Get the course file
+		const string& Course() { return course_file; }
+
+		//Lay out the segments of a course as they are read and create them in batches of SPAWN_BATCH_DOMINOES,
+		//the course is streamed however long it is
+		PxTransform BuildCourse(CourseReader& course)
+		{
+			const CourseInfo& info = course.Info();
+			PxTransform startLoc = info.start;
+			course_start = info.start;
+			box = 0;
+			layouts.clear();
+			live_segments.clear();
+
+			//one pool for all the batches
+			unique_ptr<JobSystem> build_jobs;
+			JobSystem* jobs = BuildJobs(build_jobs);
+
+			PxU32 batch_begin = 0, batch_dominoes = 0;
+			CourseSegment segment;
+			while (course.Next(segment)) {
+				PxU32 first_layout = (PxU32)layouts.size();
+				live_segments.push_back(DescribeSegment(info, segment));
+				LayoutSegment(live_segments.back(), startLoc);
+				startLoc = live_segments.back().end;
+
+				for (PxU32 i = first_layout; i < layouts.size(); i++)
+					batch_dominoes += (PxU32)layouts[i].poses.size();
+				if (batch_dominoes >= SPAWN_BATCH_DOMINOES) {
+					SpawnLiveSegments(batch_begin, (PxU32)live_segments.size(), jobs);
+					batch_begin = (PxU32)live_segments.size();
+					batch_dominoes = 0;
 				}
+			}
+			if (batch_begin < live_segments.size())
+				SpawnLiveSegments(batch_begin, (PxU32)live_segments.size(), jobs);
 
-				box = new Box(temp, PxVec3(0.0254f, 0.0508f, 0.009525f));
+			for (unsigned int i = 0; i < live_segments.size(); i++)
+				for (unsigned int j = 0; j < live_segments[i].dominoes.size(); j++)
+					AddDomino(live_segments[i].dominoes[j], i);
 
-				PxRigidDynamic* px_actor = (PxRigidDynamic*)box->Get();
-				px_actor->setGlobalPose(PxTransform(px_actor->getGlobalPose().p, startLocation.q));
-				box->Material(dominoMat);
-				box->Color(PxVec3(1.f, 1.f, 1.f));
-				box->Name("Domino");
-				Add(box);
-			}
+			if (dominoes.empty())
+				throw new Exception("MyScene::BuildCourse, the course has no dominoes.");
 
-			PxRigidDynamic* px_actor = (PxRigidDynamic*)box->Get();
-			PxVec3 position = px_actor->getGlobalPose().p;
+			box = (Domino*)dominoes.back();
+			box->Name("LastDomino"); //Setting the last domino to be spawned to have the name "LastDomino" which will be filtered for
 
-			position.x = position.x + (startLocation.q.getBasisVector2().x * 0.0616f);
-			position.y = position.y - (startLocation.q.getBasisVector1().y * 0.0116f);
-			position.z = position.z + (startLocation.q.getBasisVector2().z * 0.0616f);
+			return startLoc;
+		}
 
-			startLocation.p = position;
+		//A course segment with its material and colour looked up, ready to be laid out
+		static LiveSegment DescribeSegment(const CourseInfo& info, const CourseSegment& segment)
+		{
+			LiveSegment live;
+			live.segment = segment;
+			live.material = CourseMaterial{ 0.f, 0.f, 0.f };
+			live.color = PxVec3(0.f);
+			live.layout_count = 0;
+
+			if (segment.type != SEGMENT_HEIGHT) {
+				live.material = info.materials[segment.material];
+				live.color = info.colors[segment.color];
+			}
+			return live;
+		}
 
-			return startLocation;
+		//Segments that would be spawned the same way from the same start
+		static bool SameSegment(const LiveSegment& a, const LiveSegment& b)
+		{
+			if ((a.segment.type != b.segment.type) || (a.segment.value != b.segment.value))
+				return false;
+			if (a.segment.type == SEGMENT_HEIGHT)
+				return true;
+
+			return (a.segment.dominoes == b.segment.dominoes) && (a.material.static_friction == b.material.static_friction) &&
+				(a.material.dynamic_friction == b.material.dynamic_friction) && (a.material.restitution == b.material.restitution) &&
+				(a.color == b.color);
 		}
-		// Spawnstairs (down) -> Start location, number of dominoes (length of line), boolean for overloading downwards stairs
-		PxTransform spawnCorner(PxTransform startLocation, PxI16 noDominoes, float angleRad) // Spawns a corner with parameterized number of dominoes, angle and direction
+
+		static bool SamePose(const PxTransform& a, const PxTransform& b)
 		{
-			PxRigidDynamic* px_actor = NULL;
-			PxTransform init = startLocation;
-			PxQuat tempRot;
-			PxTransform temp;
-			float maxX = startLocation.p.x;
-			float maxZ = startLocation.p.z;
-			float minX = startLocation.p.x;
-			float minZ = startLocation.p.z;
-			temp = startLocation;
+			return ((a.p - b.p).magnitude() < 1e-5f) && (PxAbs(a.q.dot(b.q)) > 1.f - 1e-6f);
+		}
 
-			float rotateRad;
+		//Lay out a segment from startLoc
+		void LayoutSegment(LiveSegment& live, PxTransform startLoc)
+		{
+			const CourseSegment& segment = live.segment;
+			PxU32 first_layout = (PxU32)layouts.size();
+			live.start = startLoc;
 
-			rotateRad = angleRad;
+			if (segment.type == SEGMENT_HEIGHT)
+				startLoc.p.y = segment.value;
+			else {
+				dominoMat = CreateMaterial(live.material.static_friction, live.material.dynamic_friction, live.material.restitution);
+				dominoColor = live.color;
+
+				switch (segment.type) {
+				case SEGMENT_LINE:
+					startLoc = spawnLine(startLoc, segment.dominoes, (segment.value > 0.f) ? segment.value : 1.98f);
+					break;
+				case SEGMENT_CORNER:
+					startLoc = spawnCorner(startLoc, segment.dominoes, segment.value);
+					break;
+				case SEGMENT_STAIRS_UP:
+					startLoc = spawnStairs(startLoc, segment.dominoes);
+					break;
+				case SEGMENT_STAIRS_DOWN:
+					startLoc = spawnStairs(startLoc, segment.dominoes, true);
+					break;
+				case SEGMENT_BRANCH: {
+					//both first dominoes are in reach of the last one before the fork
+					PxVec3 side = startLoc.q.getBasisVector0() * ((segment.value > 0.f) ? COURSE_BRANCH_OFFSET : -COURSE_BRANCH_OFFSET);
+					PxTransform branch = spawnCorner(PxTransform(startLoc.p + side, startLoc.q), segment.dominoes, segment.value);
+					spawnLine(branch, segment.dominoes, 1.98f);
+					startLoc.p -= side;
+					break;
+				}
+				}
+			}
 
-			tempRot = startLocation.q * PxQuat(rotateRad / noDominoes, startLocation.q.getBasisVector1());
+			live.layout_count = (PxU32)layouts.size() - first_layout;
+			live.end = startLoc;
+		}
 
-			temp.p = PxVec3(
-				temp.p.x - (tempRot.getBasisVector2().x * ((0.0616f))),
-				temp.p.y,
-				temp.p.z - (tempRot.getBasisVector2().z * ((0.0616f))));
+		//Create the laid out segments and hand their actors to the live segments [begin, end) they belong to
+		void SpawnLiveSegments(PxU32 begin, PxU32 end, JobSystem* jobs)
+		{
+			CreateSegments(jobs);
+
+			PxU32 next = 0;
+			for (PxU32 i = begin; i < end; i++) {
+				LiveSegment& live = live_segments[i];
+				for (PxU32 j = 0; j < live.layout_count; j++, next++) {
+					SegmentLayout& segment = layouts[next];
+					live.dominoes.insert(live.dominoes.end(), segment.actors.begin(), segment.actors.begin() + segment.poses.size());
+					live.actors.insert(live.actors.end(), segment.actors.begin(), segment.actors.end());
+				}
+				live.layout_count = 0;
+			}
+			layouts.clear();
+		}
 
-			for (int i = 0; i < noDominoes + 1; i++) {
-				tempRot = startLocation.q * PxQuat((rotateRad / noDominoes) * i, tempRot.getBasisVector1());
+		///Apply the changes of the course file to the live course: the run of segments that differs is spawned again,
+		///the segments after it are moved along if its end moved and everything else stays untouched.
+		///The scene goes back to its reset state, returns the number of segments spawned.
+		PxU32 ReloadCourse()
+		{
+			if (generate || course_file.empty())
+				throw new Exception("MyScene::ReloadCourse, the course does not come from a file.");
+
+			unique_ptr<CourseReader> course(OpenCourse(course_file));
+			const CourseInfo& info = course->Info();
+
+			vector<LiveSegment> segments;
+			PxU32 new_dominoes = 0;
+			CourseSegment segment;
+			while (course->Next(segment)) {
+				segments.push_back(DescribeSegment(info, segment));
+				if (segment.type != SEGMENT_HEIGHT)
+					new_dominoes += segment.dominoes;
+			}
 
-				box = new Box(PxTransform(PxVec3(
-					temp.p.x + (tempRot.getBasisVector2().x * (0.0616f)),
-					temp.p.y,
-					temp.p.z + (tempRot.getBasisVector2().z * (0.0616f))
-				)), PxVec3(0.0254f, 0.0508f, 0.009525));
+			if (!new_dominoes)
+				throw new Exception("MyScene::ReloadCourse, the course has no dominoes.");
 
-				px_actor = (PxRigidDynamic*)box->Get();
-				px_actor->setGlobalPose(PxTransform(px_actor->getGlobalPose().p, tempRot));
-				temp = px_actor->getGlobalPose();
-				tempRot = px_actor->getGlobalPose().q;
+			//the hammer stands at the start, a course loaded from a collection has no live segments
+			if (live_segments.empty() || !SamePose(info.start, course_start)) {
+				Rebuild();
+				return (PxU32)live_segments.size();
+			}
 
-				if (temp.p.x > maxX) {
-					maxX = temp.p.x;
-				}
-				else if (temp.p.x < minX) {
-					minX = temp.p.x;
-				}
+			//the changed run lies between the segments both courses start and end with
+			PxU32 old_count = (PxU32)live_segments.size(), new_count = (PxU32)segments.size();
+			PxU32 prefix = 0, suffix = 0;
+			while ((prefix < PxMin(old_count, new_count)) && SameSegment(live_segments[prefix], segments[prefix]))
+				prefix++;
+			while ((suffix < PxMin(old_count, new_count) - prefix) &&
+				SameSegment(live_segments[old_count - 1 - suffix], segments[new_count - 1 - suffix]))
+				suffix++;
+
+			if ((prefix == old_count) && (prefix == new_count))
+				return 0;
+
+			//the live actors go back to where they were spawned, the frozen statics are released
+			Reset();
+
+			box->Name("Domino");
+			vector<Actor*> removed;
+			for (PxU32 i = prefix; i < old_count - suffix; i++)
+				removed.insert(removed.end(), live_segments[i].actors.begin(), live_segments[i].actors.end());
+			Remove(removed);
+
+			live_segments.erase(live_segments.begin() + prefix, live_segments.begin() + (old_count - suffix));
+			live_segments.insert(live_segments.begin() + prefix, segments.begin() + prefix, segments.begin() + (new_count - suffix));
+
+			PxU32 changed_end = new_count - suffix;
+			PxTransform startLoc = prefix ? live_segments[prefix - 1].end : course_start;
+			for (PxU32 i = prefix; i < changed_end; i++) {
+				LayoutSegment(live_segments[i], startLoc);
+				startLoc = live_segments[i].end;
+			}
 
-				if (temp.p.z > maxZ) {
-					maxZ = temp.p.z;
+			//heights are absolute and so are the floors laid out from them: if the end of the edit moved up or down,
+			//the segments up to and including the next height segment are laid out again, it puts the course back on its level
+			if ((changed_end < new_count) && (PxAbs(startLoc.p.y - live_segments[changed_end].start.p.y) > 1e-5f)) {
+				vector<Actor*> relaid;
+				while (changed_end < new_count) {
+					LiveSegment& live = live_segments[changed_end++];
+					relaid.insert(relaid.end(), live.actors.begin(), live.actors.end());
+					live.actors.clear();
+					live.dominoes.clear();
+					LayoutSegment(live, startLoc);
+					startLoc = live.end;
+					if (live.segment.type == SEGMENT_HEIGHT)
+						break;
 				}
-				else if (temp.p.z < minZ) {
-					minZ = temp.p.z;
+				Remove(relaid);
+			}
+			unique_ptr<JobSystem> build_jobs;
+			SpawnLiveSegments(prefix, changed_end, BuildJobs(build_jobs));
+
+			//the rest of the course follows the end of the edit as a whole, only along the ground and turned about y
+			if ((changed_end < new_count) && !SamePose(live_segments[changed_end].start, startLoc)) {
+				PxTransform move = startLoc * live_segments[changed_end].start.getInverse();
+				for (PxU32 i = changed_end; i < new_count; i++) {
+					LiveSegment& live = live_segments[i];
+					live.start = move * live.start;
+					live.end = move * live.end;
+					for (unsigned int j = 0; j < live.actors.size(); j++) {
+						PxRigidActor* actor = (PxRigidActor*)live.actors[j]->Get();
+						actor->setGlobalPose(move * actor->getGlobalPose());
+					}
 				}
-				box->Material(dominoMat);
-				box->Color(PxVec3(1.f, 1.f, 1.f));
-				box->Name("Domino");
-				Add(box);
 			}
 
-			px_actor = (PxRigidDynamic*)box->Get();
-			PxVec3 position = px_actor->getGlobalPose().p;
-			position.x = position.x + (tempRot.getBasisVector2().x * ((0.0616f)));
-			position.z = position.z + (tempRot.getBasisVector2().z * ((0.0616f)));
+			dominoes.clear();
+			domino_index.clear();
+			course_order.clear();
+			domino_segment.clear();
+			for (unsigned int i = 0; i < live_segments.size(); i++)
+				for (unsigned int j = 0; j < live_segments[i].dominoes.size(); j++)
+					AddDomino(live_segments[i].dominoes[j], i);
+			box = (Domino*)dominoes.back();
+			box->Name("LastDomino");
+
+			//the trigger and the cloth stay at the end of the run
+			PxTransform endLoc = live_segments.back().end;
+			((PxRigidStatic*)staticBox->Get())->setGlobalPose(endLoc);
+			((PxCloth*)cloth->Get())->setGlobalPose(PxTransform(endLoc.p + PxVec3(0.f, 4.f, 0.f), endLoc.q));
+
+			//the regions were set up around the old course, a longer one would leave the new segments out of bounds
+			if (broadphase_type == PxBroadPhaseType::eMBP)
+				SetupBroadPhaseRegions();
+
+			InitActivation();
+			Snapshot();
+
+			return changed_end - prefix;
+		}
 
-			tempRot = startLocation.q * PxQuat(rotateRad, startLocation.q.getBasisVector1());
+		//Cloth is not saved with the course, it hangs above the end of the run
+		void spawnCloth(PxTransform endLoc)
+		{
+			endLoc.p.y += 4.f;
+			cloth = new Cloth(endLoc, PxVec2(4.f, 4.f), 20, 20, true);
+			Add(cloth);
+		}
 
-			startLocation.p = position;
-			startLocation.q = tempRot;
+		//Particle marbles are not saved with the course either, an empty particle system costs next to nothing
+		void spawnParticles()
+		{
+			particles = new MarbleParticles(particle_desc, glassMat);
+			particles->Color(color_palette[0]);
+			particles->Name("Marbles");
+			Add(particles);
+		}
 
-			if (temp.p.y > 0.1f) {
-				cout << minX << endl;
-				cout << maxX << endl;
-				cout << std::abs(minX - maxX) << endl;
-				spawnFloor(init, PxTransform(PxVec3(
-					startLocation.p.x - (tempRot.getBasisVector2().x * ((0.0616f))),
-					startLocation.p.y,
-				startLocation.p.z - (tempRot.getBasisVector2().z * ((0.0616f))))), 1.8f, std::abs(minX - maxX), std::abs(minZ - maxZ)); }
+		//Custom reset: the course is back in place, park the marbles and drop the run state
+		virtual void CustomReset()
+		{
+			projectiles.Reset();
+			particles->Reset();
 
+			isDone = false;
+			moving_dominoes.clear();
+			wave_frontier = wave_moving = wave_peak = 0;
+			wave_text = "";
 
-			return PxTransform(startLocation);
+			//the snapshot brought back the parked and the lost dominoes, only the order and the grid have to be rebuilt
+			RestoreDominoes();
+			InitActivation();
+
+			//the frozen dominoes are back as dynamics, their statics are gone
+			frozen_segments.clear();
+			frozen_dominoes = 0;
 		}
-		// Spawncorner -> Start location, number of dominoes, angle of corner (radians)
 
-		void spawnFloor(PxTransform start, PxTransform end, float shrinkConst) {
+		//Custom udpate function
+		virtual void CustomUpdate(bool amIDone)
+		{
+			if (amIDone == true) {
+				isDone = amIDone;
+				return;
+			}
+
+			projectiles.Update(DeltaTime());
+			particles->Update(DeltaTime());
+
+			//hand the moving dominoes of the last step over to the wave tracker
+			moving_dominoes.clear();
+			PxU32 nb_active = 0;
+			PxActor** active = px_scene->getActiveActors(nb_active);
+			for (PxU32 i = 0; i < nb_active; i++) {
+				unordered_map<PxActor*, PxU32>::const_iterator it = domino_index.find(active[i]);
+				if (it != domino_index.end())
+					moving_dominoes.push_back(it->second);
+			}
 
-			float diffX = std::abs(start.p.x - end.p.x);
-			float diffZ = std::abs(start.p.z - end.p.z);
-			float offsetX = 0.0f;
-			float offsetZ = 0.0f;
+			if (activation_mode != ACTIVATION_OFF && activated < waiting.size())
+				ActivateNearWave(active, nb_active);
 
-			if (diffX < 0.1f) { offsetX = .03f; }
-			if (diffZ < 0.1f) { offsetZ = .03f; }
+			if (freeze && !my_callback->asleep.empty())
+				FreezeToppled();
+			my_callback->asleep.clear();
+		}
 
-			float constX;
-			if (start.p.x > end.p.x) {
-				constX = start.p.x - ((diffX) / 2);
-				//cout << "Going inverse X" << endl;
+		//Merge the dominoes that fell asleep toppled into the static of their segment.
+		//A sleeping domino has a sleeping island, so nothing still moving rests on it.
+		void FreezeToppled()
+		{
+			unordered_map<PxU32, vector<PxRigidDynamic*>> toppled;
+
+			for (unsigned int i = 0; i < my_callback->asleep.size(); i++) {
+				PxActor* actor = my_callback->asleep[i];
+				if (domino_index.find(actor) == domino_index.end() || !actor->getScene())
+					continue;
+
+				PxRigidDynamic* domino = (PxRigidDynamic*)actor;
+				//the trigger still has to see the last one
+				if (!domino->isSleeping() || (string(domino->getName()) == "LastDomino"))
+					continue;
+				if (domino->getRigidBodyFlags().isSet(PxRigidBodyFlag::eKINEMATIC))
+					continue;
+				if (PxAbs(domino->getGlobalPose().q.getBasisVector1().y) > TOPPLED_UP)
+					continue;
+
+				toppled[domino_segment[actor]].push_back(domino);
 			}
-			else {
-				constX = start.p.x + ((diffX) / 2);
-				//cout << "Going standard X" << endl;
+
+			for (unordered_map<PxU32, vector<PxRigidDynamic*>>::iterator it = toppled.begin(); it != toppled.end(); ++it) {
+				PxRigidStatic* merged = Freeze(it->second, frozen_segments[it->first]);
+				if (merged)
+					frozen_segments[it->first] = merged;
+				frozen_dominoes += (PxU32)it->second.size();
 			}
+		}
 
-			float constZ;
-			if (start.p.z > end.p.z) {
-				constZ = start.p.z - ((diffZ) / 2);
-				//cout << "Going inverse Z" << endl;
+		///Merge the toppled dominoes at rest into static geometry
+		void FreezeDominoes(bool value) { freeze = value; }
+
+		///Merge the toppled dominoes at rest into static geometry
+		bool FreezeDominoes() { return freeze; }
+
+		///Number of dominoes merged into static geometry since init or reset
+		PxU32 FrozenDominoes() { return frozen_dominoes; }
+
+		///Number of statics made of frozen dominoes
+		PxU32 FrozenSegments() { return (PxU32)frozen_segments.size(); }
+
+		///Check the spawned dominoes for penetrations during the next Init
+		void Validation(ValidationMode mode) { validation_mode = mode; }
+
+		///Get the overlap check mode
+		ValidationMode Validation() { return (ValidationMode)validation_mode; }
+
+		///Penetrations found by the last overlap check
+		PxU32 OverlapsFound() { return overlaps_found; }
+
+		///Penetrations left after correcting them
+		PxU32 OverlapsLeft() { return overlaps_left; }
+
+		///Dominoes moved by the overlap check
+		PxU32 OverlapsCorrected() { return overlaps_corrected; }
+
+		///Deepest penetration found by the last overlap check
+		PxReal MaxPenetration() { return max_penetration; }
+
+		///Set how the platforms of a segment are built, used by the next Init
+		void Floors(FloorBuilder::FloorType type) { floor_type = type; }
+
+		///Get how the platforms of a segment are built
+		FloorBuilder::FloorType Floors() { return floor_type; }
+
+		//Runs as a step task: works only on the captured indices, never on the PhysX scene
+		void TrackWave()
+		{
+			wave_moving = (PxU32)moving_dominoes.size();
+			wave_peak = PxMax(wave_peak, wave_moving);
+			for (PxU32 i = 0; i < moving_dominoes.size(); i++)
+				wave_frontier = PxMax(wave_frontier, moving_dominoes[i] + 1);
+
+			ostringstream text;
+			text << " Wave: " << wave_frontier << "/" << dominoes.size() << " dominoes, " << wave_moving << " moving";
+			wave_text = text.str();
+		}
+
+		///Topple wave summary for the HUD
+		string WaveText()
+		{
+			return wave_text;
+		}
+
+		///Furthest domino (course order) that has been set in motion
+		PxU32 WaveFrontier()
+		{
+			return wave_frontier;
+		}
+
+		///Largest number of dominoes moving at the same time
+		PxU32 WavePeak()
+		{
+			return wave_peak;
+		}
+
+		///Number of dominoes in the course
+		PxU32 Dominoes()
+		{
+			return (PxU32)dominoes.size();
+		}
+
+		///Domino at a position of the course
+		Actor* DominoActor(PxU32 index)
+		{
+			return dominoes[index];
+		}
+
+		///Set the marble pool, used by the next Init
+		void Projectiles(const ProjectilePoolDesc& desc) { projectile_desc = desc; }
+
+		///Set the particle marbles, used by the next Init
+		void Particles(const MarbleParticlesDesc& desc) { particle_desc = desc; }
+
+		///Set how the marbles are fired from now on
+		void Marbles(MarbleMode mode) { marble_mode = mode; }
+
+		///Get how the marbles are fired
+		MarbleMode Marbles() { return (MarbleMode)marble_mode; }
+
+		///Number of marbles in the pool or the particle system, whichever is firing
+		PxU32 ProjectileCapacity() { return (marble_mode == MARBLES_PARTICLES) ? particles->Capacity() : projectiles.Capacity(); }
+
+		///Number of marbles in flight, rigid and particles
+		PxU32 ProjectilesFlying() { return projectiles.Flying() + particles->Flying(); }
+
+		//Close the segment being laid out
+		void AddSegment()
+		{
+			layout.material = dominoMat;
+			layout.color = dominoColor;
+			layouts.push_back(move(layout));
+			layout = SegmentLayout();
+		}
+
+		//Lay out a domino of the current segment
+		PxTransform PlaceDomino(const PxTransform& pose)
+		{
+			layout.poses.push_back(pose);
+			return pose;
+		}
+
+		//Job system that creates the segments: the one of the scene if there is one, else a pool owned by the caller
+		//for the whole build, 0 on a single core
+		JobSystem* BuildJobs(unique_ptr<JobSystem>& build_jobs)
+		{
+			JobSystem* jobs = GetJobSystem();
+			if (!jobs && (thread::hardware_concurrency() > 1)) {
+				build_jobs.reset(new JobSystem(thread::hardware_concurrency() - 1));
+				jobs = build_jobs.get();
 			}
-			else {
-				constZ = start.p.z + ((diffZ) / 2);
-				//cout << "Going standard Z" << endl;
+			return jobs;
+		}
+
+		//Create the actors of the laid out segments in parallel on jobs (creating actors and shapes is thread safe),
+		//then add them to the scene in course order, the dominoes and floors of a segment share a broadphase entry (the layouts are kept)
+		void CreateSegments(JobSystem* jobs)
+		{
+			Exception* error = 0;
+			mutex error_lock;
+			auto create = [this, &error, &error_lock](PxU32 begin, PxU32 end) {
+				try {
+					for (PxU32 i = begin; i < end; i++) {
+						SegmentLayout& segment = layouts[i];
+						for (unsigned int j = 0; j < segment.poses.size(); j++) {
+							Domino* domino = new Domino(segment.poses[j], segment.material);
+							domino->Color(segment.color);
+							domino->Name("Domino");
+							segment.actors.push_back(domino);
+						}
+
+						vector<Actor*> floors = segment.floor.Build(floor_type);
+						for (unsigned int j = 0; j < floors.size(); j++) {
+							floors[j]->Color(PxVec3(0.f, 0.f, 0.f));
+							segment.actors.push_back(floors[j]);
+						}
+					}
+				}
+				catch (Exception* e) {
+					lock_guard<mutex> guard(error_lock);
+					if (error)
+						delete e;
+					else
+						error = e;
+				}
+			};
+
+			if (jobs)
+				jobs->ParallelFor((PxU32)layouts.size(), create);
+			else
+				create(0, (PxU32)layouts.size());
+
+			if (error) {
+				for (unsigned int i = 0; i < layouts.size(); i++)
+					for (unsigned int j = 0; j < layouts[i].actors.size(); j++)
+						delete layouts[i].actors[j];
+				layouts.clear();
+				throw error;
 			}
 
+			//one batch per segment, in course order
+			for (unsigned int i = 0; i < layouts.size(); i++)
+				AddAggregate(layouts[i].actors);
+		}
 
-			staticBox = new SBox(PxTransform(PxVec3(constX, start.p.y - 0.15f, constZ)), PxVec3(offsetX + diffX / shrinkConst, 0.1f, offsetZ + diffZ / shrinkConst));
+		//Keep a domino in the course order
+		void AddDomino(Actor* domino, PxU32 segment)
+		{
+			//the freeze pass picks its candidates from the sleep events
+			domino->Get()->setActorFlag(PxActorFlag::eSEND_SLEEP_NOTIFIES, true);
 
-			staticBox->Color(PxVec3(0.f, 0.f, 0.f));
+			domino_index[domino->Get()] = (PxU32)dominoes.size();
+			dominoes.push_back(domino);
+			course_order.push_back(domino);
+			domino_segment[domino->Get()] = segment;
+		}
 
-			Add(staticBox);
+		//Drop dominoes that left the scene from the course order, the later ones move up and the activation grid follows
+		void RemoveDominoes(PxActor* const* actors, PxU32 count)
+		{
+			vector<bool> lost(dominoes.size(), false);
+			PxU32 nb_lost = 0;
+			for (PxU32 i = 0; i < count; i++) {
+				unordered_map<PxActor*, PxU32>::const_iterator it = domino_index.find(actors[i]);
+				if (it != domino_index.end()) {
+					lost[it->second] = true;
+					nb_lost++;
+				}
+			}
+			if (!nb_lost)
+				return;
+
+			//new index of every domino that stays
+			vector<PxU32> remap(dominoes.size(), 0);
+			PxU32 kept = 0;
+			for (unsigned int i = 0; i < dominoes.size(); i++) {
+				if (lost[i]) {
+					domino_index.erase(dominoes[i]->Get());
+					continue;
+				}
+				remap[i] = kept;
+				dominoes[kept] = dominoes[i];
+				domino_index[dominoes[kept]->Get()] = kept;
+				if (i < waiting.size())
+					waiting[kept] = waiting[i];
+				kept++;
+			}
+			dominoes.resize(kept);
+			if (waiting.size())
+				waiting.resize(kept);
+
+			for (unordered_map<PxU64, vector<PxU32>>::iterator cell = waiting_cells.begin(); cell != waiting_cells.end();) {
+				vector<PxU32>& indices = cell->second;
+				PxU32 left = 0;
+				for (unsigned int j = 0; j < indices.size(); j++) {
+					if (!lost[indices[j]])
+						indices[left++] = remap[indices[j]];
+				}
+				indices.resize(left);
+				if (indices.empty())
+					cell = waiting_cells.erase(cell);
+				else
+					++cell;
+			}
+
+			//indices of the last step
+			moving_dominoes.clear();
 		}
 
-		void spawnFloor(PxTransform start, PxTransform end, float shrinkConst, float diffX, float diffZ) {
-			float offsetX = 0.0f;
-			float offsetZ = 0.0f;
+		//Put every domino of the course back in order once the lost ones are in the scene again
+		void RestoreDominoes()
+		{
+			dominoes = course_order;
+			domino_index.clear();
+			for (unsigned int i = 0; i < dominoes.size(); i++)
+				domino_index[dominoes[i]->Get()] = i;
+		}
 
-			if (diffX < 0.1f) { offsetX = .03f; }
-			if (diffZ < 0.1f) { offsetZ = .03f; }
+		//Lay out a segment kind from startLocation: its local poses are filled once, then each domino is a single
+		//transform multiply. Returns where the next segment starts.
+		template<class Kind>
+		PxTransform PlaceSegment(const PxTransform& startLocation, PxU32 noDominoes, PxReal value)
+		{
+			local_poses.resize(Kind::Count(noDominoes));
+			LocalPose end = Kind::Fill(noDominoes, value, local_poses.data());
 
-			float constX;
-			if (start.p.x > end.p.x) {
-				constX = start.p.x - ((diffX) / 2);
-				//cout << "Going inverse X" << endl;
-			}
-			else {
-				constX = start.p.x + ((diffX) / 2);
-				//cout << "Going standard X" << endl;
+			for (unsigned int i = 0; i < local_poses.size(); i++)
+				PlaceDomino(startLocation * local_poses[i].Transform());
+
+			return startLocation * end.Transform();
+		}
+
+		PxTransform spawnLine(PxTransform startLocation, PxU32 noDominoes, float shrink) // Spawns a straight line in the forward vector of the transform passed to the function
+		{
+			PxTransform end = PlaceSegment<LineKind>(startLocation, noDominoes, 0.f);
+
+			if ((startLocation.p.y > 0.1f) && noDominoes) {
+				PxTransform floorStart = startLocation * PxTransform(PxVec3(0.f, 0.f, -COURSE_SPACING));
+				spawnFloor(floorStart, layout.poses.back(), shrink, std::abs(floorStart.p.x - layout.poses.back().p.x), std::abs(floorStart.p.z - layout.poses.back().p.z));
 			}
 
-			float constZ;
-			if (start.p.z > end.p.z) {
-				constZ = start.p.z - ((diffZ) / 2);
-				//cout << "Going inverse Z" << endl;
+			AddSegment();
+
+			return end;
+		}
+		// Spawnline -> Start location, number of dominoes (length of line), size of platform below floating dominoes
+		PxTransform spawnStairs(PxTransform startLocation, PxU32 noDominoes, bool forDown=false) {
+
+			PxTransform end = forDown ? PlaceSegment<StairsKind<-1> >(startLocation, noDominoes, 0.f) :
+				PlaceSegment<StairsKind<1> >(startLocation, noDominoes, 0.f);
+
+			// Every stair above the ground stands on its own platform
+			for (unsigned int i = 0; i < layout.poses.size(); i++) {
+				if (layout.poses[i].p.y > 0.01f) {
+					spawnFloor(layout.poses[i], layout.poses[i], 2.0f, 0.f, 0.f);
+				}
 			}
-			else {
-				constZ = start.p.z + ((diffZ) / 2);
-				//cout << "Going standard Z" << endl;
+
+			AddSegment();
+
+			return end;
+		}
+		// Spawnstairs -> Start location, number of dominoes (length of line), true for downwards stairs
+		PxTransform spawnCorner(PxTransform startLocation, PxU32 noDominoes, float angleRad) // Spawns a corner with parameterized number of dominoes, angle and direction
+		{
+			PxTransform end = PlaceSegment<CornerKind>(startLocation, noDominoes, angleRad);
+
+			if (layout.poses.back().p.y > 0.1f) {
+				PxVec3 low = startLocation.p, high = startLocation.p;
+				for (unsigned int i = 0; i < layout.poses.size(); i++) {
+					low = low.minimum(layout.poses[i].p);
+					high = high.maximum(layout.poses[i].p);
+				}
+				spawnFloor(startLocation, layout.poses.back(), 1.8f, high.x - low.x, high.z - low.z);
 			}
 
+			AddSegment();
 
-			staticBox = new SBox(PxTransform(PxVec3(constX, start.p.y - 0.15f, constZ)), PxVec3(offsetX + diffX / shrinkConst, 0.1f, offsetZ + diffZ / shrinkConst));
+			return end;
+		}
+		// Spawncorner -> Start location, number of dominoes, angle of corner (radians)
 
-			staticBox->Color(PxVec3(0.f, 0.f, 0.f));
+		//Platform under the run from start towards end: diffX and diffZ are the extents of the run, divided by shrinkConst,
+		//a run along one axis gets a minimum width across it
+		void spawnFloor(PxTransform start, PxTransform end, float shrinkConst, float diffX, float diffZ) {
+			float offsetX = (diffX < 0.1f) ? .03f : 0.0f;
+			float offsetZ = (diffZ < 0.1f) ? .03f : 0.0f;
 
-			Add(staticBox);
+			//centred between start and end
+			float constX = start.p.x + ((start.p.x > end.p.x) ? -diffX : diffX) / 2;
+			float constZ = start.p.z + ((start.p.z > end.p.z) ? -diffZ : diffZ) / 2;
+
+			layout.floor.Add(PxTransform(PxVec3(constX, start.p.y - 0.15f, constZ)), PxVec3(offsetX + diffX / shrinkConst, 0.1f, offsetZ + diffZ / shrinkConst));
 		}
 
 		/// An example use of key release handling
@@ -577,38 +1478,69 @@ namespace PhysicsEngine
 			cerr << "I am pressed!" << endl;
 		}
 
-		void Fire(PxTransform camera) { // Function to fire 10 marbles from camera
-			if (!bullets.empty() && !bullets2.empty()) { // If statement clearing the list of bullets that is older. This allows for exactly two lists of marbles.
-				if (currentList == true) { //Depending on the value of a boolean currentList, clear the list not in current use
-					for (int i = 0; i < bullets.size(); i++) {
-						bullets[i]->Get()->release(); 
-					}
-					bullets.clear();
-				}
-				else
-				{
-					for (int i = 0; i < bullets2.size(); i++) {
-						bullets2[i]->Get()->release();
-					}
-					bullets2.clear();
-				}
+		void Fire(PxTransform camera) { // Function to fire a volley of marbles from camera, the oldest marbles in flight are reused once the pool is empty
+			if (marble_mode == MARBLES_PARTICLES) {
+				FireVolley(camera, PARTICLE_VOLLEY);
+				return;
 			}
-
-			for (int i = 0; i < 10; i++) { //For loop spawning all 10 marbles
+			for (PxU32 i = 0; i < VOLLEY_SIZE; i++) {
 				PxTransform marbLoc = camera;
-				marbLoc.p.x += (i * 0.1 * marbLoc.q.getBasisVector2().x); //We use the basis vector to orient the marbles position based on the cameras rotation
-				marbLoc.p.z += (i * 0.1 * marbLoc.q.getBasisVector2().z);
-				marble = new Sphere(marbLoc, 0.013f);
-				marble->Color(color_palette[0]);
-				PxRigidDynamic* temp = (PxRigidDynamic*)marble->Get();
-				Add(marble);
-				if (currentList == true) {	bullets.push_back(marble);} //Use the switch boolean to decide which list to add the marbles to
-				else {bullets2.push_back(marble);}
-				marble->Material(CreateMaterial(0.9f, 0.4f, .658f)); //Applying the material properties of glass to the marbles
-				marble->Name("Bullet");
-				temp->addForce(camera.q.getBasisVector2() * -0.0002f, PxForceMode::eIMPULSE); //Applying a small, but relative to the size of the marbles, significant impulse
-			}
-			currentList = !currentList; //Switch the boolean
+				marbLoc.p.x += (i * 0.1f * marbLoc.q.getBasisVector2().x); //We use the basis vector to orient the marbles position based on the cameras rotation
+				marbLoc.p.z += (i * 0.1f * marbLoc.q.getBasisVector2().z);
+				FireMarble(marbLoc, camera.q.getBasisVector2() * -MARBLE_IMPULSE); //Applying a small, but relative to the size of the marbles, significant impulse
+			}
+		}
+
+		///Fire a single marble from the pool, returns its actor
+		Actor* FireMarble(const PxTransform& pose, const PxVec3& impulse)
+		{
+			return projectiles.Fire(pose, impulse);
+		}
+
+		///Fire count marbles at once from a square across the view of camera, as set by Marbles, returns the number fired.
+		///Rigid marbles beyond the pool capacity reuse the ones just fired, particles beyond the free room are not fired.
+		PxU32 FireVolley(const PxTransform& camera, PxU32 count)
+		{
+			PxU32 side = (PxU32)PxCeil(PxSqrt((PxReal)count));
+			PxReal spacing = 3.f * ((marble_mode == MARBLES_PARTICLES) ? particle_desc.radius : projectile_desc.radius);
+			PxVec3 right = camera.q.getBasisVector0() * spacing;
+			PxVec3 up = camera.q.getBasisVector1() * spacing;
+			PxReal centre = .5f * (side - 1);
+
+			volley_positions.clear();
+			for (PxU32 i = 0; i < count; i++)
+				volley_positions.push_back(camera.p + right * ((i % side) - centre) + up * ((i / side) - centre));
+
+			//the particles get the speed a fired rigid marble gets from its impulse
+			PxVec3 forward = -camera.q.getBasisVector2();
+			if (marble_mode == MARBLES_PARTICLES)
+				return particles->Fire(volley_positions.data(), count, forward * (MARBLE_IMPULSE / particles->Mass()));
+
+			for (PxU32 i = 0; i < count; i++)
+				FireMarble(PxTransform(volley_positions[i], camera.q), forward * MARBLE_IMPULSE);
+			return PxMin(count, projectiles.Capacity());
+		}
+
+		//Park a marble that left the broadphase regions instead of removing it, a lost domino leaves the course order
+		virtual void CustomOutOfBounds(PxActor* actor)
+		{
+			if (projectiles.Park(actor))
+				return;
+
+			Scene::CustomOutOfBounds(actor);
+			if (!actor->getScene())
+				RemoveDominoes(&actor, 1);
+		}
+
+		//A segment that left the broadphase regions takes its dominoes out of the course order
+		virtual void CustomOutOfBounds(PxAggregate* aggregate)
+		{
+			vector<PxActor*> actors(aggregate->getNbActors());
+			aggregate->getActors(actors.data(), (PxU32)actors.size());
+
+			Scene::CustomOutOfBounds(aggregate);
+			if (!aggregate->getScene())
+				RemoveDominoes(actors.data(), (PxU32)actors.size());
 		}
 
 		bool dominoesDone() {
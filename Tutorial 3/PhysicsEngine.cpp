@@ -1,5 +1,12 @@
 #include "PhysicsEngine.h"
+#include "MeshCache.h"
+#include "Hash.h"
 #include <iostream>
+#include <thread>
+#include <map>
+#include <algorithm>
+#include <unordered_set>
+#include <mutex>
 
 namespace PhysicsEngine
 {
@@ -19,6 +26,33 @@ namespace PhysicsEngine
 #endif
 	PxPhysics* physics = 0;
 	PxCooking* cooking = 0;
+	JobSystem* job_system = 0;
+	//scenes simulating on the job system
+	PxU32 job_system_users = 0;
+	PxSerializationRegistry* serialization_registry = 0;
+
+	//shared shapes by geometry parameters and material
+	struct ShapeKey
+	{
+		PxU32 type;
+		PxReal params[3];
+		PxMaterial* material;
+
+		bool operator<(const ShapeKey& other) const
+		{
+			if (type != other.type)
+				return type < other.type;
+			for (int i = 0; i < 3; i++)
+				if (params[i] != other.params[i])
+					return params[i] < other.params[i];
+			return material < other.material;
+		}
+	};
+	std::map<ShapeKey, PxShape*> shared_shapes;
+	//materials of the loaded collections go with their scene, they are not handed out for reuse
+	std::unordered_set<PxMaterial*> loaded_materials;
+	//course segments are created on several threads
+	std::mutex shared_shape_lock;
 
 	///PhysX functions
 	void PxInit()
@@ -70,6 +104,16 @@ namespace PhysicsEngine
 
 	void PxRelease()
 	{
+		delete job_system;
+		job_system = 0;
+		job_system_users = 0;
+		for (std::map<ShapeKey, PxShape*>::iterator it = shared_shapes.begin(); it != shared_shapes.end(); ++it)
+			it->second->release();
+		shared_shapes.clear();
+		ReleaseMeshCache();
+		if (serialization_registry)
+			serialization_registry->release();
+		serialization_registry = 0;
 		if (cooking)
 			cooking->release();
 		if (physics)
@@ -101,9 +145,104 @@ namespace PhysicsEngine
 
 	PxMaterial* CreateMaterial(PxReal sf, PxReal df, PxReal cr)
 	{
+		//reuse a material with the same coefficients and default settings
+		std::vector<PxMaterial*> materials(physics->getNbMaterials());
+		if (materials.size())
+			physics->getMaterials(materials.data(), (PxU32)materials.size());
+
+		for (unsigned int i = 0; i < materials.size(); i++)
+		{
+			PxMaterial* material = materials[i];
+			if (loaded_materials.count(material))
+				continue;
+			if ((material->getStaticFriction() == sf) && (material->getDynamicFriction() == df) && (material->getRestitution() == cr) &&
+				(material->getFlags() == PxMaterialFlags()) &&
+				(material->getFrictionCombineMode() == PxCombineMode::eAVERAGE) && (material->getRestitutionCombineMode() == PxCombineMode::eAVERAGE))
+				return material;
+		}
+
 		return physics->createMaterial(sf, df, cr);
 	}
 
+	PxShape* GetSharedShape(const PxGeometry& geometry, PxMaterial* material)
+	{
+		ShapeKey key = { (PxU32)geometry.getType(), { 0.f, 0.f, 0.f }, material };
+
+		switch (geometry.getType())
+		{
+		case PxGeometryType::eSPHERE:
+			key.params[0] = ((const PxSphereGeometry&)geometry).radius;
+			break;
+		case PxGeometryType::eBOX:
+			key.params[0] = ((const PxBoxGeometry&)geometry).halfExtents.x;
+			key.params[1] = ((const PxBoxGeometry&)geometry).halfExtents.y;
+			key.params[2] = ((const PxBoxGeometry&)geometry).halfExtents.z;
+			break;
+		case PxGeometryType::eCAPSULE:
+			key.params[0] = ((const PxCapsuleGeometry&)geometry).radius;
+			key.params[1] = ((const PxCapsuleGeometry&)geometry).halfHeight;
+			break;
+		default:
+			throw new Exception("PhysicsEngine::GetSharedShape, unsupported geometry type.");
+		}
+
+		std::lock_guard<std::mutex> guard(shared_shape_lock);
+
+		std::map<ShapeKey, PxShape*>::iterator it = shared_shapes.find(key);
+		if (it != shared_shapes.end())
+			return it->second;
+
+		PxShape* shape = physics->createShape(geometry, *material, false);
+		if (!shape)
+			throw new Exception("PhysicsEngine::GetSharedShape, could not create the shape.");
+
+		shared_shapes[key] = shape;
+		return shape;
+	}
+
+	JobSystem* CreateJobSystem(PxU32 num_threads, const std::vector<PxU32>& affinity_masks)
+	{
+		if (job_system_users)
+			throw new Exception("PhysicsEngine::CreateJobSystem, the job system is used by a scene.");
+
+		delete job_system;
+		job_system = new JobSystem(num_threads, affinity_masks);
+		return job_system;
+	}
+
+	JobSystem* AcquireJobSystem(PxU32 num_threads, const std::vector<PxU32>& affinity_masks)
+	{
+		if (!job_system || (!job_system_users && (job_system->getWorkerCount() != num_threads)))
+			CreateJobSystem(num_threads, affinity_masks);
+		else if (job_system->getWorkerCount() != num_threads)
+			cerr << "PhysicsEngine::AcquireJobSystem, the job system is in use, keeping its " << job_system->getWorkerCount() << " worker thread(s)" << endl;
+
+		job_system_users++;
+		return job_system;
+	}
+
+	void ReleaseJobSystem()
+	{
+		if (job_system_users)
+			job_system_users--;
+	}
+
+	JobSystem* GetJobSystem()
+	{
+		return job_system;
+	}
+
+	PxSerializationRegistry* GetSerializationRegistry()
+	{
+		if (!serialization_registry)
+			serialization_registry = PxSerialization::createSerializationRegistry(*physics);
+
+		if (!serialization_registry)
+			throw new Exception("PhysicsEngine::GetSerializationRegistry, could not create the registry.");
+
+		return serialization_registry;
+	}
+
 	///Actor methods
 
 	PxActor* Actor::Get()
@@ -139,6 +278,8 @@ namespace PhysicsEngine
 		std::vector<PxShape*> shape_list = GetShapes(shape_index);
 		for (PxU32 i = 0; i < shape_list.size(); i++)
 		{
+			if (!shape_list[i]->isExclusive())
+				throw new Exception("Actor::Material, cannot change the material of a shared shape.");
 			std::vector<PxMaterial*> materials(shape_list[i]->getNbMaterials());
 			for (unsigned int j = 0; j < materials.size(); j++)
 				materials[j] = new_material;
@@ -183,13 +324,78 @@ namespace PhysicsEngine
 	{
 		std::vector<PxShape*> shape_list = GetShapes(shape_index);
 		for (PxU32 i = 0; i < shape_list.size(); i++)
-			shape_list[i]->setSimulationFilterData(PxFilterData(filterGroup, filterMask, 0, 0));
+		{
+			//the flags in word2 are kept
+			PxFilterData data = shape_list[i]->getSimulationFilterData();
+			data.word0 = filterGroup;
+			data.word1 = filterMask;
+			shape_list[i]->setSimulationFilterData(data);
+		}
 
-		// PxFilterData(word0, word1, 0, 0)
+		// PxFilterData(word0, word1, word2, 0)
 		// word0 = own ID
 		// word1 = ID mask to filter pairs that trigger a contact callback
+		// word2 = FilterFlag bits
+	}
+
+
+	void Actor::LinkColors()
+	{
+		std::vector<PxShape*> shapes = GetShapes();
+		UserData* actor_data = (UserData*)actor->userData;
+		bool shared_linked = false;
+
+		for (unsigned int i = 0; i < shapes.size() && i < colors.size(); i++)
+		{
+			if (shapes[i]->isExclusive())
+				((UserData*)shapes[i]->userData)->color = &colors[i];
+			else if (actor_data && !shared_linked)
+			{
+				actor_data->color = &colors[i];
+				shared_linked = true;
+			}
+		}
 	}
 
+	void Actor::ReleaseUserData()
+	{
+		if (!actor)
+			return;
+
+		std::vector<PxShape*> shapes = GetShapes();
+		for (unsigned int i = 0; i < shapes.size(); i++)
+		{
+			if (shapes[i]->isExclusive())
+			{
+				delete (UserData*)shapes[i]->userData;
+				shapes[i]->userData = 0;
+			}
+		}
+
+		delete (UserData*)actor->userData;
+		actor->userData = 0;
+	}
+
+	void Actor::Adopt(PxRigidActor* existing, const std::vector<PxVec3>& shape_colors)
+	{
+		actor = existing;
+		colors = shape_colors;
+
+		std::vector<PxShape*> shapes = GetShapes();
+		colors.resize(shapes.size(), default_color);
+
+		//user data is not serialized
+		for (unsigned int i = 0; i < shapes.size(); i++)
+		{
+			if (shapes[i]->isExclusive())
+				shapes[i]->userData = new UserData();
+			else if (!actor->userData)
+				actor->userData = new UserData();
+		}
+
+		LinkColors();
+		Name(actor->getName() ? actor->getName() : "");
+	}
 
 	void Actor::Name(const string& new_name)
 	{
@@ -208,10 +414,14 @@ namespace PhysicsEngine
 		Name("");
 	}
 
+	DynamicActor::DynamicActor(PxRigidDynamic* existing, const std::vector<PxVec3>& shape_colors) : Actor()
+	{
+		Adopt(existing, shape_colors);
+	}
+
 	DynamicActor::~DynamicActor()
 	{
-		for (unsigned int i = 0; i < colors.size(); i++)
-			delete (UserData*)GetShape(i)->userData;
+		ReleaseUserData();
 	}
 
 	void DynamicActor::CreateShape(const PxGeometry& geometry, PxReal density)
@@ -219,10 +429,18 @@ namespace PhysicsEngine
 		PxShape* shape = ((PxRigidDynamic*)actor)->createShape(geometry, *GetMaterial());
 		PxRigidBodyExt::updateMassAndInertia(*(PxRigidDynamic*)actor, density);
 		colors.push_back(default_color);
-		//pass the color pointers to the renderer
 		shape->userData = new UserData();
-		for (unsigned int i = 0; i < colors.size(); i++)
-			((UserData*)GetShape(i)->userData)->color = &colors[i];
+		LinkColors();
+	}
+
+	void DynamicActor::AttachShape(PxShape* shape, PxReal density)
+	{
+		((PxRigidDynamic*)actor)->attachShape(*shape);
+		PxRigidBodyExt::updateMassAndInertia(*(PxRigidDynamic*)actor, density);
+		colors.push_back(default_color);
+		if (!actor->userData)
+			actor->userData = new UserData();
+		LinkColors();
 	}
 
 	void DynamicActor::SetKinematic(bool value, PxU32 index)
@@ -234,41 +452,125 @@ namespace PhysicsEngine
 #endif
 	}
 
+	void DynamicActor::SetCCD(bool value)
+	{
+		((PxRigidDynamic*)actor)->setRigidBodyFlag(PxRigidBodyFlag::eENABLE_CCD, value);
+
+		//the filter shader asks for swept contacts of the flagged shapes
+		std::vector<PxShape*> shape_list = GetShapes();
+		for (PxU32 i = 0; i < shape_list.size(); i++)
+		{
+			PxFilterData data = shape_list[i]->getSimulationFilterData();
+			data.word2 = value ? (data.word2 | FilterFlag::CCD) : (data.word2 & ~(PxU32)FilterFlag::CCD);
+			shape_list[i]->setSimulationFilterData(data);
+		}
+	}
+
 	StaticActor::StaticActor(const PxTransform& pose)
 	{
 		actor = (PxActor*)GetPhysics()->createRigidStatic(pose);
 		Name("");
 	}
 
+	StaticActor::StaticActor(PxRigidStatic* existing, const std::vector<PxVec3>& shape_colors) : Actor()
+	{
+		Adopt(existing, shape_colors);
+	}
+
 	StaticActor::~StaticActor()
 	{
-		for (unsigned int i = 0; i < colors.size(); i++)
-			delete (UserData*)GetShape(i)->userData;
+		ReleaseUserData();
 	}
 
 	void StaticActor::CreateShape(const PxGeometry& geometry, PxReal density)
 	{
 		PxShape* shape = ((PxRigidStatic*)actor)->createShape(geometry, *GetMaterial());
 		colors.push_back(default_color);
-		//pass the color pointers to the renderer
 		shape->userData = new UserData();
-		for (unsigned int i = 0; i < colors.size(); i++)
-			((UserData*)GetShape(i)->userData)->color = &colors[i];
+		LinkColors();
+	}
+
+	///Step task methods
+	void StepJoin::run()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		done = true;
+		finished.notify_all();
+	}
+
+	void StepJoin::Reset()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		done = false;
+	}
+
+	void StepJoin::Wait()
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		finished.wait(guard, [this]() { return done; });
 	}
 
 	///Scene methods
 	void Scene::Init()
+	{
+		CreateScene();
+
+		CustomInit();
+
+		FinishInit();
+	}
+
+	void Scene::CreateScene()
 	{
 		//scene
 		PxSceneDesc sceneDesc(GetPhysics()->getTolerancesScale());
 
 		if (!sceneDesc.cpuDispatcher)
 		{
-			PxDefaultCpuDispatcher* mCpuDispatcher = PxDefaultCpuDispatcherCreate(1);
-			sceneDesc.cpuDispatcher = mCpuDispatcher;
+			PxU32 threads = num_threads;
+			if (threads == AUTO_THREADS)
+			{
+				PxU32 cores = std::thread::hardware_concurrency();
+				threads = (cores > 1) ? cores - 1 : 0;
+			}
+
+			//one mask per worker, a shorter list is repeated over the workers
+			std::vector<PxU32> masks;
+			if (threads && affinity_masks.size())
+			{
+				if (affinity_masks.size() != threads)
+					cerr << "PhysicsEngine::Scene::Init, " << affinity_masks.size() << " affinity mask(s) for " << threads << " worker thread(s), repeating them" << endl;
+				for (PxU32 i = 0; i < threads; i++)
+					masks.push_back(affinity_masks[i % affinity_masks.size()]);
+			}
+
+			if (dispatcher_type == JOB_SYSTEM_DISPATCHER)
+			{
+				//the job system is shared with the application and the other scenes, it is recreated only if the thread count differs and nobody uses it
+				JobSystem* jobs = AcquireJobSystem(threads, masks);
+				shared_dispatcher = true;
+				threads = jobs->getWorkerCount();
+				sceneDesc.cpuDispatcher = jobs;
+			}
+			else
+			{
+				cpu_dispatcher = PxDefaultCpuDispatcherCreate(threads, masks.size() ? masks.data() : 0);
+				sceneDesc.cpuDispatcher = cpu_dispatcher;
+			}
+
+			cout << "PhysicsEngine::Scene::Init, using " << threads << " worker thread(s)" << endl;
 		}
 
-		sceneDesc.filterShader = PxDefaultSimulationFilterShader;
+		sceneDesc.filterShader = filter_shader;
+
+		if (use_ccd)
+			sceneDesc.flags |= PxSceneFlag::eENABLE_CCD;
+
+		//let scenes look at the moving actors only
+		sceneDesc.flags |= PxSceneFlag::eENABLE_ACTIVE_ACTORS;
+
+		sceneDesc.broadPhaseType = broadphase_type;
+		sceneDesc.broadPhaseCallback = &out_of_bounds;
 
 		px_scene = GetPhysics()->createScene(sceneDesc);
 
@@ -277,8 +579,16 @@ namespace PhysicsEngine
 
 		//default gravity
 		px_scene->setGravity(PxVec3(0.0f, -9.81f, 0.0f));
+	}
 
-		CustomInit();
+	void Scene::FinishInit()
+	{
+		if (broadphase_type == PxBroadPhaseType::eMBP)
+			SetupBroadPhaseRegions();
+
+		CustomSettle();
+
+		Snapshot();
 
 		pause = false;
 
@@ -292,15 +602,416 @@ namespace PhysicsEngine
 		if (pause)
 			return;
 
+		delta_time = dt;
 		CustomUpdate(false);
 
-		px_scene->simulate(dt);
-		px_scene->fetchResults(true);
+		if (step_tasks.empty())
+		{
+			px_scene->simulate(dt);
+			px_scene->fetchResults(true);
+		}
+		else
+		{
+			//the completion task and all step tasks continue into the join
+			step_join.Reset();
+			step_join.setContinuation(*px_scene->getTaskManager(), 0);
+			simulation_complete.setContinuation(&step_join);
+
+			px_scene->simulate(dt, &simulation_complete);
+			simulation_complete.removeReference();
+
+			//step tasks overlap with the solver
+			for (unsigned int i = 0; i < step_tasks.size(); i++)
+			{
+				step_tasks[i]->setContinuation(&step_join);
+				step_tasks[i]->removeReference();
+			}
+			step_join.removeReference();
+
+			px_scene->fetchResults(true);
+			step_join.Wait();
+		}
+
+		HandleOutOfBounds();
+	}
+
+	PxReal Scene::DeltaTime()
+	{
+		return delta_time;
+	}
+
+	void OutOfBoundsQueue::onObjectOutOfBounds(PxShape& shape, PxActor& actor)
+	{
+		//reported once for every shape of the actor
+		if (std::find(actors.begin(), actors.end(), &actor) == actors.end())
+			actors.push_back(&actor);
+	}
+
+	void OutOfBoundsQueue::onObjectOutOfBounds(PxAggregate& aggregate)
+	{
+		if (std::find(aggregates.begin(), aggregates.end(), &aggregate) == aggregates.end())
+			aggregates.push_back(&aggregate);
+	}
+
+	void Scene::SetupBroadPhaseRegions()
+	{
+		std::vector<PxActor*> actors = GetAllActors();
+
+		PxBounds3 bounds = PxBounds3::empty();
+		for (unsigned int i = 0; i < actors.size(); i++)
+		{
+			//parked actors are not in the broadphase
+			if (actors[i]->getActorFlags() & PxActorFlag::eDISABLE_SIMULATION)
+				continue;
+
+			//planes are infinite and do not need a region
+			bool infinite = false;
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			if (actors[i]->isRigidActor())
+#else
+			if (actors[i]->is<PxRigidActor>())
+#endif
+			{
+				std::vector<PxShape*> shapes(((PxRigidActor*)actors[i])->getNbShapes());
+				((PxRigidActor*)actors[i])->getShapes(shapes.data(), (PxU32)shapes.size());
+				for (unsigned int j = 0; j < shapes.size(); j++)
+					infinite |= (shapes[j]->getGeometryType() == PxGeometryType::ePLANE);
+			}
+
+			if (!infinite)
+				bounds.include(actors[i]->getWorldBounds());
+		}
+
+		if (bounds.isEmpty())
+			return;
+
+		bounds.fattenFast(region_margin);
+
+		std::vector<PxBounds3> regions(region_subdivisions * region_subdivisions);
+		PxU32 nb_regions = PxBroadPhaseExt::createRegionsFromWorldBounds(regions.data(), bounds, region_subdivisions);
+
+		//the new regions go in before the old ones are removed, so no actor is left outside of all of them
+		std::vector<PxU32> old_regions;
+		old_regions.swap(broadphase_regions);
+		for (PxU32 i = 0; i < nb_regions; i++)
+		{
+			PxBroadPhaseRegion region;
+			region.bounds = regions[i];
+			region.userData = 0;
+			//populate the region with the actors already in the scene
+			PxU32 handle = px_scene->addBroadPhaseRegion(region, true);
+			if (handle == 0xffffffff)
+				throw new Exception("Scene::SetupBroadPhaseRegions, could not add the broadphase region.");
+			broadphase_regions.push_back(handle);
+		}
+
+		for (unsigned int i = 0; i < old_regions.size(); i++)
+			px_scene->removeBroadPhaseRegion(old_regions[i]);
+
+		cout << "PhysicsEngine::Scene::Init, using " << nb_regions << " MBP region(s)" << endl;
+	}
+
+	void Scene::HandleOutOfBounds()
+	{
+		//the objects cannot be removed from within the broadphase callback
+		for (unsigned int i = 0; i < out_of_bounds.aggregates.size(); i++)
+			CustomOutOfBounds(out_of_bounds.aggregates[i]);
+		out_of_bounds.aggregates.clear();
+
+		for (unsigned int i = 0; i < out_of_bounds.actors.size(); i++)
+			CustomOutOfBounds(out_of_bounds.actors[i]);
+		out_of_bounds.actors.clear();
+	}
+
+	void Scene::CustomOutOfBounds(PxActor* actor)
+	{
+		//already gone with its aggregate
+		if (actor->getScene() != px_scene)
+			return;
+
+		if (actor == selected_actor)
+		{
+			HighlightOff(selected_actor);
+			selected_actor = 0;
+		}
+
+		//also takes the actor out of its aggregate
+		px_scene->removeActor(*actor);
+
+		if (!selected_actor)
+			SelectNextActor();
+	}
+
+	void Scene::CustomOutOfBounds(PxAggregate* aggregate)
+	{
+		if (aggregate->getScene() != px_scene)
+			return;
+
+		//the selected actor goes with the aggregate
+		std::vector<PxActor*> actors(aggregate->getNbActors());
+		aggregate->getActors(actors.data(), (PxU32)actors.size());
+		if (std::find(actors.begin(), actors.end(), (PxActor*)selected_actor) != actors.end())
+		{
+			HighlightOff(selected_actor);
+			selected_actor = 0;
+		}
+
+		px_scene->removeAggregate(*aggregate);
+
+		if (!selected_actor)
+			SelectNextActor();
+	}
+
+	StepTask* Scene::AddStepTask(const char* name, const std::function<void()>& function)
+	{
+		StepTask* task = new StepTask(name, function);
+		step_tasks.push_back(task);
+		return task;
 	}
 
 	void Scene::Add(Actor* actor)
 	{
 		px_scene->addActor(*actor->Get());
+		actor_wrappers.push_back(actor);
+	}
+
+	void Scene::AddBatch(const std::vector<Actor*>& actors)
+	{
+		if (actors.empty())
+			return;
+
+		std::vector<PxActor*> px_actors(actors.size());
+		for (unsigned int i = 0; i < actors.size(); i++)
+			px_actors[i] = actors[i]->Get();
+
+		px_scene->addActors(px_actors.data(), (PxU32)px_actors.size());
+		actor_wrappers.insert(actor_wrappers.end(), actors.begin(), actors.end());
+	}
+
+	void Scene::AddAggregate(const std::vector<Actor*>& actors, bool self_collisions)
+	{
+		if (!use_aggregates)
+		{
+			AddBatch(actors);
+			return;
+		}
+
+		for (unsigned int begin = 0; begin < actors.size(); begin += MAX_AGGREGATE_SIZE)
+		{
+			PxU32 size = PxMin((PxU32)(actors.size() - begin), MAX_AGGREGATE_SIZE);
+			PxAggregate* aggregate = GetPhysics()->createAggregate(size, self_collisions);
+			if (!aggregate)
+				throw new Exception("Scene::AddAggregate, could not create the aggregate.");
+
+			for (PxU32 i = 0; i < size; i++)
+			{
+				if (!aggregate->addActor(*actors[begin + i]->Get()))
+					throw new Exception("Scene::AddAggregate, could not add the actor to the aggregate.");
+			}
+
+			px_scene->addAggregate(*aggregate);
+			aggregates.push_back(aggregate);
+		}
+
+		actor_wrappers.insert(actor_wrappers.end(), actors.begin(), actors.end());
+	}
+
+	void Scene::Remove(const std::vector<Actor*>& actors)
+	{
+		std::unordered_set<Actor*> removed(actors.begin(), actors.end());
+		std::unordered_set<PxAggregate*> emptied;
+
+		for (unsigned int i = 0; i < actors.size(); i++)
+		{
+			PxActor* actor = actors[i]->Get();
+			if (actor == selected_actor)
+			{
+				HighlightOff(selected_actor);
+				selected_actor = 0;
+			}
+
+			//the wrapper frees the renderer data, the actor leaves its scene and aggregate on release
+			PxAggregate* aggregate = actor->getAggregate();
+			delete actors[i];
+			actor->release();
+
+			if (aggregate && !aggregate->getNbActors())
+				emptied.insert(aggregate);
+		}
+
+		aggregates.erase(std::remove_if(aggregates.begin(), aggregates.end(),
+			[&emptied](PxAggregate* aggregate) { return emptied.count(aggregate) > 0; }), aggregates.end());
+		for (std::unordered_set<PxAggregate*>::iterator it = emptied.begin(); it != emptied.end(); ++it)
+			(*it)->release();
+
+		actor_wrappers.erase(std::remove_if(actor_wrappers.begin(), actor_wrappers.end(),
+			[&removed](Actor* actor) { return removed.count(actor) > 0; }), actor_wrappers.end());
+
+		//the snapshot still refers to the released actors
+		snapshot.Clear();
+
+		if (!selected_actor)
+			SelectNextActor();
+	}
+
+	void Scene::Save(const std::string& file_name)
+	{
+		PxSerializationRegistry* registry = GetSerializationRegistry();
+		PxCollection* collection = PxCreateCollection();
+
+		//cloth cannot be serialized and particles are created again with the course, the aggregates bring their actors along
+		std::vector<PxActor*> actors = GetAllActors();
+		std::unordered_set<PxActor*> saved;
+		for (unsigned int i = 0; i < actors.size(); i++)
+		{
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			if (actors[i]->isCloth() || actors[i]->isParticleSystem())
+#else
+			if (actors[i]->is<PxCloth>() || actors[i]->is<PxParticleSystem>())
+#endif
+				continue;
+
+			PxAggregate* aggregate = actors[i]->getAggregate();
+			if (aggregate && !collection->contains(*aggregate))
+				collection->add(*aggregate);
+			collection->add(*actors[i]);
+			saved.insert(actors[i]);
+		}
+
+		std::vector<PxJoint*> joints = GetAllJoints();
+		for (unsigned int i = 0; i < joints.size(); i++)
+			collection->add(*joints[i]);
+
+		//add the shapes, materials and meshes and name every object
+		PxSerialization::complete(*collection, *registry);
+		PxSerialization::createSerialObjectIds(*collection, PxSerialObjectId(1));
+
+		if (!PxSerialization::isSerializable(*collection, *registry))
+		{
+			collection->release();
+			throw new Exception("Scene::Save, the scene cannot be serialized.");
+		}
+
+		PxDefaultMemoryOutputStream stream;
+		if (!PxSerialization::serializeCollectionToBinary(stream, *collection, *registry, 0, true))
+		{
+			collection->release();
+			throw new Exception("Scene::Save, serialization failed.");
+		}
+
+		//side table with the wrappers of the saved actors (wrappers of released actors are skipped)
+		std::vector<SceneFileActor> table;
+		for (unsigned int i = 0; i < actor_wrappers.size(); i++)
+		{
+			PxActor* actor = actor_wrappers[i]->Get();
+			if (saved.find(actor) == saved.end())
+				continue;
+
+			SceneFileActor entry;
+			entry.id = collection->getId(*actor);
+			entry.name = actor_wrappers[i]->Name();
+			for (PxU32 j = 0; actor_wrappers[i]->Color(j); j++)
+				entry.colors.push_back(*actor_wrappers[i]->Color(j));
+			table.push_back(entry);
+		}
+
+		collection->release();
+
+		WriteSceneFile(file_name, stream.getData(), stream.getSize(), table);
+	}
+
+	void Scene::Load(const std::string& file_name)
+	{
+		MappedFile* file = new MappedFile();
+		if (!file->Open(file_name))
+		{
+			delete file;
+			throw new Exception("Scene::Load, could not open the file.");
+		}
+
+		std::vector<SceneFileActor> table;
+		try
+		{
+			ReadSceneFile(*file, table);
+
+			CreateScene();
+
+			//the objects are created in place, in the (copy-on-write) mapped memory
+			loaded_collection = PxSerialization::createCollectionFromBinary(file->Data() + SceneFileHeader::COLLECTION_OFFSET, *GetSerializationRegistry());
+			if (!loaded_collection)
+				throw new Exception("Scene::Load, could not deserialize the collection.");
+		}
+		catch (Exception*)
+		{
+			delete file;
+			throw;
+		}
+		//the file has to stay mapped as long as the objects live
+		loaded_file = file;
+
+		px_scene->addCollection(*loaded_collection);
+
+		for (PxU32 i = 0; i < loaded_collection->getNbObjects(); i++)
+		{
+			PxBase& object = loaded_collection->getObject(i);
+			if (object.getConcreteType() == PxConcreteType::eMATERIAL)
+				loaded_materials.insert((PxMaterial*)&object);
+		}
+
+		for (unsigned int i = 0; i < table.size(); i++)
+		{
+			PxBase* object = loaded_collection->find(table[i].id);
+			if (!object)
+				continue;
+
+			Actor* actor;
+			if (object->getConcreteType() == PxConcreteType::eRIGID_DYNAMIC)
+				actor = new DynamicActor((PxRigidDynamic*)object, table[i].colors);
+			else if (object->getConcreteType() == PxConcreteType::eRIGID_STATIC)
+				actor = new StaticActor((PxRigidStatic*)object, table[i].colors);
+			else
+				continue;
+
+			actor->Name(table[i].name);
+			actor_wrappers.push_back(actor);
+			loaded_actors.push_back(actor);
+		}
+
+		CustomLoad();
+
+		FinishInit();
+	}
+
+	void Scene::Aggregates(bool value)
+	{
+		use_aggregates = value;
+	}
+
+	bool Scene::Aggregates()
+	{
+		return use_aggregates;
+	}
+
+	void Scene::CCD(bool value)
+	{
+		use_ccd = value;
+	}
+
+	bool Scene::CCD()
+	{
+		return use_ccd;
+	}
+
+	void Scene::BroadPhase(PxBroadPhaseType::Enum type, PxU32 subdivisions, PxReal margin)
+	{
+		broadphase_type = type;
+		region_subdivisions = PxMax(subdivisions, (PxU32)1);
+		region_margin = margin;
+	}
+
+	PxBroadPhaseType::Enum Scene::BroadPhase()
+	{
+		return broadphase_type;
 	}
 
 	PxScene* Scene::Get()
@@ -310,10 +1021,383 @@ namespace PhysicsEngine
 
 	void Scene::Reset()
 	{
-		px_scene->release();
+		if (snapshot.Empty())
+		{
+			Rebuild();
+			return;
+		}
+
+		//the selected actor may not survive the reset
+		if (selected_actor)
+			HighlightOff(selected_actor);
+
+		snapshot.Restore(px_scene);
+
+		//the restored dynamics replace the statics made of them
+		ReleaseFrozen();
+
+		CustomReset();
+
+		pause = false;
+
+		if (selected_actor && !snapshot.Contains(selected_actor))
+			selected_actor = 0;
+
+		if (selected_actor)
+			HighlightOn(selected_actor);
+		else
+			SelectNextActor();
+	}
+
+	bool Scene::Settle(const std::vector<Actor*>& actors, std::vector<PxTransform>& poses, PxReal dt, PxU32 max_steps)
+	{
+		SceneSnapshot before;
+		before.Capture(px_scene);
+
+		bool settled = false;
+		for (PxU32 step = 0; step < max_steps && !settled; step++)
+		{
+			px_scene->simulate(dt);
+			px_scene->fetchResults(true);
+			HandleOutOfBounds();
+
+			settled = true;
+			for (unsigned int i = 0; i < actors.size() && settled; i++)
+			{
+				PxRigidDynamic* actor = (PxRigidDynamic*)actors[i]->Get();
+				settled = !actor->getScene() || actor->isSleeping();
+			}
+		}
+
+		poses.resize(actors.size());
+		for (unsigned int i = 0; i < actors.size(); i++)
+			poses[i] = ((PxRigidActor*)actors[i]->Get())->getGlobalPose();
+
+		before.Restore(px_scene);
+
+		return settled;
+	}
+
+	PxU64 Scene::CourseHash()
+	{
+		Hash hash;
+		hash.Add((PxU32)PX_PHYSICS_VERSION);
+
+		for (unsigned int i = 0; i < actor_wrappers.size(); i++)
+		{
+			PxActor* actor = actor_wrappers[i]->Get();
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			if (!actor->isRigidActor())
+#else
+			if (!actor->is<PxRigidActor>())
+#endif
+				continue;
+
+			hash.Add((PxU32)actor->getConcreteType());
+			hash.Add(((PxRigidActor*)actor)->getGlobalPose());
+
+			std::vector<PxShape*> shapes = actor_wrappers[i]->GetShapes();
+			for (unsigned int j = 0; j < shapes.size(); j++)
+			{
+				PxGeometryHolder geometry = shapes[j]->getGeometry();
+				hash.Add(shapes[j]->getLocalPose());
+				hash.Add((PxU32)geometry.getType());
+				switch (geometry.getType())
+				{
+				case PxGeometryType::eSPHERE:
+					hash.Add(geometry.sphere().radius);
+					break;
+				case PxGeometryType::eBOX:
+					hash.Add(geometry.box().halfExtents);
+					break;
+				case PxGeometryType::eCAPSULE:
+					hash.Add(geometry.capsule().radius);
+					hash.Add(geometry.capsule().halfHeight);
+					break;
+				case PxGeometryType::eCONVEXMESH:
+					hash.Add(geometry.convexMesh().convexMesh->getNbVertices());
+					hash.Add(geometry.convexMesh().convexMesh->getVertices(), geometry.convexMesh().convexMesh->getNbVertices() * sizeof(PxVec3));
+					break;
+				case PxGeometryType::eTRIANGLEMESH:
+					hash.Add(geometry.triangleMesh().triangleMesh->getNbVertices());
+					hash.Add(geometry.triangleMesh().triangleMesh->getVertices(), geometry.triangleMesh().triangleMesh->getNbVertices() * sizeof(PxVec3));
+					break;
+				case PxGeometryType::eHEIGHTFIELD:
+				{
+					const PxHeightFieldGeometry& field = geometry.heightField();
+					std::vector<PxHeightFieldSample> samples(field.heightField->getNbRows() * field.heightField->getNbColumns());
+					field.heightField->saveCells(samples.data(), (PxU32)(samples.size() * sizeof(PxHeightFieldSample)));
+					hash.Add(field.heightField->getNbRows());
+					hash.Add(field.heightScale);
+					hash.Add(field.rowScale);
+					hash.Add(field.columnScale);
+					hash.Add(samples.data(), samples.size() * sizeof(PxHeightFieldSample));
+					break;
+				}
+				default:
+					break;
+				}
+
+				//the rest poses depend on the friction and the bounce as well
+				std::vector<PxMaterial*> materials(shapes[j]->getNbMaterials());
+				shapes[j]->getMaterials(materials.data(), (PxU32)materials.size());
+				hash.Add((PxU32)materials.size());
+				for (unsigned int k = 0; k < materials.size(); k++)
+				{
+					hash.Add(materials[k]->getStaticFriction());
+					hash.Add(materials[k]->getDynamicFriction());
+					hash.Add(materials[k]->getRestitution());
+				}
+			}
+		}
+
+		return hash.Value();
+	}
+
+	PxRigidStatic* Scene::Freeze(const std::vector<PxRigidDynamic*>& actors, PxRigidStatic* merged)
+	{
+		bool created = !merged;
+		if (created)
+			merged = GetPhysics()->createRigidStatic(PxTransform(PxIdentity));
+
+		PxTransform inverse = merged->getGlobalPose().getInverse();
+
+		for (unsigned int i = 0; i < actors.size(); i++)
+		{
+			PxRigidDynamic* actor = actors[i];
+			if (actor->getScene() != px_scene)
+				continue;
+
+			if (actor == selected_actor)
+			{
+				HighlightOff(selected_actor);
+				selected_actor = 0;
+			}
+
+			PxTransform pose = inverse * actor->getGlobalPose();
+			std::vector<PxShape*> shapes(actor->getNbShapes());
+			actor->getShapes(shapes.data(), (PxU32)shapes.size());
+
+			for (unsigned int j = 0; j < shapes.size(); j++)
+			{
+				std::vector<PxMaterial*> materials(shapes[j]->getNbMaterials());
+				shapes[j]->getMaterials(materials.data(), (PxU32)materials.size());
+
+				PxShape* shape = GetPhysics()->createShape(shapes[j]->getGeometry().any(), materials.data(), (PxU16)materials.size(), true, shapes[j]->getFlags());
+				shape->setLocalPose(pose * shapes[j]->getLocalPose());
+				shape->setSimulationFilterData(shapes[j]->getSimulationFilterData());
+				shape->setQueryFilterData(shapes[j]->getQueryFilterData());
+				shape->setContactOffset(shapes[j]->getContactOffset());
+				shape->setRestOffset(shapes[j]->getRestOffset());
+				//the colour stays with the wrapper of the dynamic
+				shape->userData = new UserData(ShapeColor(shapes[j], actor));
+
+				merged->attachShape(*shape);
+				shape->release();
+			}
+
+			px_scene->removeActor(*actor);
+		}
+
+		if (created && !merged->getNbShapes())
+		{
+			merged->release();
+			merged = 0;
+		}
+		else if (created)
+		{
+			px_scene->addActor(*merged);
+			frozen.push_back(merged);
+		}
+
+		if (!selected_actor)
+			SelectNextActor();
+
+		return merged;
+	}
+
+	void Scene::ReleaseFrozen()
+	{
+		for (unsigned int i = 0; i < frozen.size(); i++)
+		{
+			std::vector<PxShape*> shapes(frozen[i]->getNbShapes());
+			frozen[i]->getShapes(shapes.data(), (PxU32)shapes.size());
+			for (unsigned int j = 0; j < shapes.size(); j++)
+				delete (UserData*)shapes[j]->userData;
+
+			frozen[i]->release();
+		}
+		frozen.clear();
+	}
+
+	std::vector<Overlap> Scene::FindOverlaps(const std::vector<PxRigidActor*>& actors, PxReal tolerance)
+	{
+		//queries per batch and touches kept per query
+		const PxU32 batch_size = 256;
+		const PxU32 max_touches = 32;
+
+		std::vector<Overlap> overlaps;
+		std::unordered_set<PxRigidActor*> checked(actors.begin(), actors.end());
+
+		//one query per shape of every actor
+		std::vector<std::pair<PxRigidActor*, PxShape*> > queries;
+		for (unsigned int i = 0; i < actors.size(); i++)
+		{
+			if (actors[i]->getScene() != px_scene)
+				continue;
+
+			std::vector<PxShape*> shapes(actors[i]->getNbShapes());
+			actors[i]->getShapes(shapes.data(), (PxU32)shapes.size());
+			for (unsigned int j = 0; j < shapes.size(); j++)
+			{
+				if (shapes[j]->getFlags() & PxShapeFlag::eSIMULATION_SHAPE)
+					queries.push_back(std::make_pair(actors[i], shapes[j]));
+			}
+		}
+
+		std::vector<PxOverlapQueryResult> results(batch_size);
+		std::vector<PxOverlapHit> touches(batch_size * max_touches);
+
+		PxBatchQueryDesc desc(0, 0, batch_size);
+		desc.queryMemory.userOverlapResultBuffer = results.data();
+		desc.queryMemory.userOverlapTouchBuffer = touches.data();
+		desc.queryMemory.overlapTouchBufferSize = (PxU32)touches.size();
+
+		PxBatchQuery* batch = px_scene->createBatchQuery(desc);
+		if (!batch)
+			throw new Exception("Scene::FindOverlaps, could not create the batch query.");
+
+		//every hit is a touch, all of them are needed
+		PxQueryFilterData filter(PxQueryFlag::eSTATIC | PxQueryFlag::eDYNAMIC | PxQueryFlag::eNO_BLOCK);
+
+		for (unsigned int begin = 0; begin < queries.size(); begin += batch_size)
+		{
+			PxU32 count = PxMin((PxU32)(queries.size() - begin), batch_size);
+			for (PxU32 i = 0; i < count; i++)
+			{
+				PxRigidActor* actor = queries[begin + i].first;
+				PxShape* shape = queries[begin + i].second;
+				batch->overlap(shape->getGeometry().any(), PxShapeExt::getGlobalPose(*shape, *actor), (PxU16)max_touches, filter,
+					(void*)(size_t)(begin + i));
+			}
+			batch->execute();
+
+			for (PxU32 i = 0; i < count; i++)
+			{
+				PxU32 index = (PxU32)(size_t)results[i].userData;
+				PxRigidActor* actor = queries[index].first;
+				PxShape* shape = queries[index].second;
+				PxTransform pose = PxShapeExt::getGlobalPose(*shape, *actor);
+
+				for (PxU32 j = 0; j < results[i].nbTouches; j++)
+				{
+					const PxOverlapHit& hit = results[i].touches[j];
+					if ((hit.actor == actor) || !(hit.shape->getFlags() & PxShapeFlag::eSIMULATION_SHAPE))
+						continue;
+					//the other actor of a checked pair reports it
+					if (checked.count(hit.actor) && (hit.actor < actor))
+						continue;
+
+					Overlap overlap = { actor, hit.actor, PxVec3(0.f), 0.f };
+					if (PxGeometryQuery::computePenetration(overlap.direction, overlap.depth, shape->getGeometry().any(), pose,
+						hit.shape->getGeometry().any(), PxShapeExt::getGlobalPose(*hit.shape, *hit.actor)) && (overlap.depth > tolerance))
+						overlaps.push_back(overlap);
+				}
+			}
+		}
+
+		batch->release();
+		return overlaps;
+	}
+
+	void Scene::Snapshot()
+	{
+		snapshot.Capture(px_scene);
+	}
+
+	void Scene::Rebuild()
+	{
+		Release();
 		Init();
 	}
 
+	void Scene::Release()
+	{
+		snapshot.Clear();
+
+		if (px_scene)
+			px_scene->release();
+		px_scene = 0;
+		broadphase_regions.clear();
+
+		ReleaseFrozen();
+
+		//the scene only removes its aggregates
+		for (unsigned int i = 0; i < aggregates.size(); i++)
+			aggregates[i]->release();
+		aggregates.clear();
+
+		actor_wrappers.clear();
+
+		//the loaded objects have to go before their memory
+		for (unsigned int i = 0; i < loaded_actors.size(); i++)
+			delete loaded_actors[i];
+		loaded_actors.clear();
+
+		if (loaded_collection)
+		{
+			for (PxU32 i = 0; i < loaded_collection->getNbObjects(); i++)
+			{
+				PxBase& object = loaded_collection->getObject(i);
+				if (object.getConcreteType() == PxConcreteType::eMATERIAL)
+					loaded_materials.erase((PxMaterial*)&object);
+			}
+			PxCollectionExt::releaseObjects(*loaded_collection);
+			loaded_collection->release();
+		}
+		loaded_collection = 0;
+
+		delete loaded_file;
+		loaded_file = 0;
+
+		//the dispatcher can go only after the scene that uses it
+		if (cpu_dispatcher)
+			cpu_dispatcher->release();
+		cpu_dispatcher = 0;
+		if (shared_dispatcher)
+			ReleaseJobSystem();
+		shared_dispatcher = false;
+
+		//the tasks are registered again by the next CustomInit
+		for (unsigned int i = 0; i < step_tasks.size(); i++)
+			delete step_tasks[i];
+		step_tasks.clear();
+	}
+
+	void Scene::Threads(PxU32 value, const std::vector<PxU32>& masks)
+	{
+		num_threads = value;
+		affinity_masks = masks;
+	}
+
+	PxU32 Scene::Threads()
+	{
+		if (px_scene)
+			return px_scene->getCpuDispatcher()->getWorkerCount();
+		else
+			return 0;
+	}
+
+	void Scene::Dispatcher(DispatcherType value)
+	{
+		dispatcher_type = value;
+	}
+
+	Scene::DispatcherType Scene::Dispatcher()
+	{
+		return (DispatcherType)dispatcher_type;
+	}
+
 	void Scene::Pause(bool value)
 	{
 		pause = value;
@@ -333,41 +1417,68 @@ namespace PhysicsEngine
 	{
 #if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
 		std::vector<PxRigidDynamic*> actors(px_scene->getNbActors(PxActorTypeSelectionFlag::eRIGID_DYNAMIC));
-		if (actors.size() && (px_scene->getActors(PxActorTypeSelectionFlag::eRIGID_DYNAMIC, (PxActor**)&actors.front(), (PxU32)actors.size())))
+		if (actors.size() && !px_scene->getActors(PxActorTypeSelectionFlag::eRIGID_DYNAMIC, (PxActor**)&actors.front(), (PxU32)actors.size()))
 #else
 		std::vector<PxRigidDynamic*> actors(px_scene->getNbActors(PxActorTypeFlag::eRIGID_DYNAMIC));
-		if (actors.size() && (px_scene->getActors(PxActorTypeFlag::eRIGID_DYNAMIC, (PxActor**)&actors.front(), (PxU32)actors.size())))
+		if (actors.size() && !px_scene->getActors(PxActorTypeFlag::eRIGID_DYNAMIC, (PxActor**)&actors.front(), (PxU32)actors.size()))
 #endif
+			actors.clear();
+
+		//the selected actor is still in the scene, possibly parked since it was selected
+		if (selected_actor && (std::find(actors.begin(), actors.end(), selected_actor) != actors.end()))
+			HighlightOff(selected_actor);
+
+		//parked actors are out of the simulation, forces and poses cannot be applied to them
+		PxU32 nb_selectable = 0;
+		for (unsigned int i = 0; i < actors.size(); i++)
+			if (!(actors[i]->getActorFlags() & PxActorFlag::eDISABLE_SIMULATION))
+				actors[nb_selectable++] = actors[i];
+		actors.resize(nb_selectable);
+
+		if (actors.size())
 		{
-			if (selected_actor)
-			{
-				for (unsigned int i = 0; i < actors.size(); i++)
-					if (selected_actor == actors[i])
-					{
-						HighlightOff(selected_actor);
-						//select the next actor
-						selected_actor = actors[(i + 1) % actors.size()];
-						break;
-					}
-			}
+			//select the next actor, the first one if the selected actor is gone
+			std::vector<PxRigidDynamic*>::iterator it = std::find(actors.begin(), actors.end(), selected_actor);
+			if (selected_actor && (it != actors.end()))
+				selected_actor = actors[((it - actors.begin()) + 1) % actors.size()];
 			else
-			{
 				selected_actor = actors[0];
-			}
 			HighlightOn(selected_actor);
 		}
 		else
 			selected_actor = 0;
 	}
 
+	std::vector<PxJoint*> Scene::GetAllJoints()
+	{
+		std::vector<PxConstraint*> constraints(px_scene->getNbConstraints());
+		if (constraints.size())
+			px_scene->getConstraints(constraints.data(), (PxU32)constraints.size());
+
+		std::vector<PxJoint*> joints;
+		for (unsigned int i = 0; i < constraints.size(); i++)
+		{
+			PxU32 type_id;
+			void* external = constraints[i]->getExternalReference(type_id);
+			if (type_id == PxConstraintExtIDs::eJOINT)
+				joints.push_back((PxJoint*)external);
+		}
+		return joints;
+	}
+
+	const std::vector<Actor*>& Scene::Actors()
+	{
+		return actor_wrappers;
+	}
+
 	std::vector<PxActor*> Scene::GetAllActors()
 	{
 #if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
 		physx::PxActorTypeSelectionFlags selection_flag = PxActorTypeSelectionFlag::eRIGID_DYNAMIC | PxActorTypeSelectionFlag::eRIGID_STATIC |
-			PxActorTypeSelectionFlag::eCLOTH;
+			PxActorTypeSelectionFlag::eCLOTH | PxActorTypeSelectionFlag::ePARTICLE_SYSTEM;
 #else
 		physx::PxActorTypeFlags selection_flag = PxActorTypeFlag::eRIGID_DYNAMIC | PxActorTypeFlag::eRIGID_STATIC |
-			PxActorTypeFlag::eCLOTH;
+			PxActorTypeFlag::eCLOTH | PxActorTypeFlag::ePARTICLE_SYSTEM;
 #endif
 		std::vector<PxActor*> actors(px_scene->getNbActors(selection_flag));
 		px_scene->getActors(selection_flag, (PxActor**)&actors.front(), (PxU32)actors.size());
@@ -381,12 +1492,20 @@ namespace PhysicsEngine
 		actor->getShapes((PxShape**)&shapes.front(), (PxU32)shapes.size());
 
 		sactor_color_orig.clear();
+		bool shared_done = false;
 
 		for (unsigned int i = 0; i < shapes.size(); i++)
 		{
-			PxVec3* color = ((UserData*)shapes[i]->userData)->color;
+			PxVec3* color = ShapeColor(shapes[i], actor);
 			sactor_color_orig.push_back(*color);
-			*color += PxVec3(.2f, .2f, .2f);
+			//shared shapes have a single colour per actor
+			if (shapes[i]->isExclusive())
+				*color += PxVec3(.2f, .2f, .2f);
+			else if (!shared_done)
+			{
+				*color += PxVec3(.2f, .2f, .2f);
+				shared_done = true;
+			}
 		}
 	}
 
@@ -396,7 +1515,7 @@ namespace PhysicsEngine
 		std::vector<PxShape*> shapes(actor->getNbShapes());
 		actor->getShapes((PxShape**)&shapes.front(), (PxU32)shapes.size());
 
-		for (unsigned int i = 0; i < shapes.size(); i++)
-			*((UserData*)shapes[i]->userData)->color = sactor_color_orig[i];
+		for (unsigned int i = shapes.size(); i-- > 0;)
+			*ShapeColor(shapes[i], actor) = sactor_color_orig[i];
 	}
 }
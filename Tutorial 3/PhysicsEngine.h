@@ -4,7 +4,13 @@
 #include "PxPhysicsAPI.h"
 #include "Exception.h"
 #include "Extras\UserData.h"
+#include "JobSystem.h"
+#include "SceneSnapshot.h"
+#include "SceneFile.h"
 #include <string>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
 
 namespace PhysicsEngine
 {
@@ -26,11 +32,41 @@ namespace PhysicsEngine
 	///Get the specified material
 	PxMaterial* GetMaterial(PxU32 index=0);
 
-	///Create a new material
+	///Create a new material or reuse an existing one with the same coefficients
+	///(materials are shared, so do not modify the returned one)
 	PxMaterial* CreateMaterial(PxReal sf=.0f, PxReal df=.0f, PxReal cr=.0f);
 
+	///Get a shape shared by all actors with the same geometry and material (sphere, box and capsule only)
+	PxShape* GetSharedShape(const PxGeometry& geometry, PxMaterial* material);
+
+	///Create the shared job system, replacing the existing one (not allowed while a scene uses it)
+	JobSystem* CreateJobSystem(PxU32 num_threads, const std::vector<PxU32>& affinity_masks=std::vector<PxU32>());
+
+	///Get the shared job system for a scene, created with num_threads workers if there is none or nobody uses it,
+	///every call has to be matched by ReleaseJobSystem
+	JobSystem* AcquireJobSystem(PxU32 num_threads, const std::vector<PxU32>& affinity_masks=std::vector<PxU32>());
+
+	///Stop using the shared job system (it is kept until PxRelease or the next CreateJobSystem)
+	void ReleaseJobSystem();
+
+	///Get the shared job system (0 if it was not created)
+	JobSystem* GetJobSystem();
+
+	///Get the serialization registry, created on first use
+	PxSerializationRegistry* GetSerializationRegistry();
+
 	static const PxVec3 default_color(.8f,.8f,.8f);
 
+	///Bits of word2 of the simulation filter data, read by the filter shader of the scene
+	struct FilterFlag
+	{
+		enum Enum
+		{
+			//swept CCD for every pair of the shape
+			CCD			= (1 << 0)
+		};
+	};
+
 	///Abstract Actor class
 	///Inherit from this class to create your own actors
 	class Actor
@@ -40,6 +76,15 @@ namespace PhysicsEngine
 		std::vector<PxVec3> colors;
 		std::string name;
 
+		//pass the color pointers to the renderer
+		void LinkColors();
+
+		//release the renderer data of the shapes and the actor
+		void ReleaseUserData();
+
+		//take over an existing actor, e.g. a deserialized one, with the given shape colours
+		void Adopt(PxRigidActor* existing, const std::vector<PxVec3>& shape_colors);
+
 	public:
 		///Constructor
 		Actor()
@@ -47,6 +92,9 @@ namespace PhysicsEngine
 		{
 		}
 
+		///Derived actors free their renderer data, also when deleted through an Actor pointer
+		virtual ~Actor() {}
+
 		PxActor* Get();
 
 		void Color(PxVec3 new_color, PxU32 shape_index=-1);
@@ -75,11 +123,20 @@ namespace PhysicsEngine
 	public:
 		DynamicActor(const PxTransform& pose);
 
+		///Wrap an existing actor
+		DynamicActor(PxRigidDynamic* existing, const std::vector<PxVec3>& shape_colors=std::vector<PxVec3>());
+
 		~DynamicActor();
 
 		void CreateShape(const PxGeometry& geometry, PxReal density);
 
+		///Attach a shared shape, all shared shapes of the actor use the colour of the first one
+		void AttachShape(PxShape* shape, PxReal density);
+
 		void SetKinematic(bool value, PxU32 index=-1);
+
+		///Sweep the actor with CCD, only in a scene with CCD enabled and a filter shader that reads FilterFlag::CCD
+		void SetCCD(bool value);
 	};
 
 	class StaticActor : public Actor
@@ -87,11 +144,73 @@ namespace PhysicsEngine
 	public:
 		StaticActor(const PxTransform& pose);
 
+		///Wrap an existing actor
+		StaticActor(PxRigidStatic* existing, const std::vector<PxVec3>& shape_colors=std::vector<PxVec3>());
+
 		~StaticActor();
 
 		void CreateShape(const PxGeometry& geometry, PxReal density=0.f);
 	};
 
+	///A task that runs on the dispatcher while the scene simulates.
+	///It must not access the PhysX scene: work on data captured in CustomUpdate instead.
+	class StepTask : public PxLightCpuTask
+	{
+		const char* name;
+		std::function<void()> function;
+
+	public:
+		StepTask(const char* _name, const std::function<void()>& _function=std::function<void()>())
+			: name(_name), function(_function) {}
+
+		virtual void run() { if (function) function(); }
+
+		virtual const char* getName() const { return name; }
+	};
+
+	///Continuation of all step tasks, lets the scene wait for them after fetchResults
+	class StepJoin : public PxLightCpuTask
+	{
+		std::mutex lock;
+		std::condition_variable finished;
+		bool done;
+
+	public:
+		StepJoin() : done(true) {}
+
+		virtual void run();
+
+		virtual const char* getName() const { return "Scene::StepJoin"; }
+
+		///Prepare for the next step
+		void Reset();
+
+		///Block until the task has run
+		void Wait();
+	};
+
+	///Collects the objects that left all broadphase regions, the scene handles them after fetchResults
+	class OutOfBoundsQueue : public PxBroadPhaseCallback
+	{
+	public:
+		std::vector<PxActor*> actors;
+		std::vector<PxAggregate*> aggregates;
+
+		virtual void onObjectOutOfBounds(PxShape& shape, PxActor& actor);
+
+		virtual void onObjectOutOfBounds(PxAggregate& aggregate);
+	};
+
+	///A shape of one actor penetrating a shape of another, see Scene::FindOverlaps.
+	///Moving the actor by direction * depth separates the two shapes.
+	struct Overlap
+	{
+		PxRigidActor* actor;
+		PxRigidActor* other;
+		PxVec3 direction;
+		PxReal depth;
+	};
+
 	///Generic scene class
 	class Scene
 	{
@@ -100,19 +219,92 @@ namespace PhysicsEngine
 		PxScene* px_scene;
 		//pause simulation
 		bool pause;
+		//time step of the current or the last Update
+		PxReal delta_time;
 		//selected dynamic actor on the scene
 		PxRigidDynamic* selected_actor;
 		//original and modified colour of the selected actor
 		std::vector<PxVec3> sactor_color_orig;
 		//custom filter shader
 		PxSimulationFilterShader filter_shader;
+		//requested number of worker threads
+		PxU32 num_threads;
+		//optional affinity mask for each worker thread
+		std::vector<PxU32> affinity_masks;
+		//which dispatcher runs the simulation tasks
+		PxU32 dispatcher_type;
+		//cpu dispatcher created by the scene
+		PxDefaultCpuDispatcher* cpu_dispatcher;
+		//the scene simulates on the shared job system
+		bool shared_dispatcher;
+		//user tasks run during simulate
+		std::vector<StepTask*> step_tasks;
+		//completion task passed to simulate
+		StepTask simulation_complete;
+		//continuation of all step tasks
+		StepJoin step_join;
+		//group actors added together into aggregates
+		bool use_aggregates;
+		//continuous collision detection for the actors that ask for it
+		bool use_ccd;
+		//aggregates created by the scene
+		std::vector<PxAggregate*> aggregates;
+		//broadphase algorithm and the setup of the MBP regions
+		PxBroadPhaseType::Enum broadphase_type;
+		PxU32 region_subdivisions;
+		PxReal region_margin;
+		//handles of the MBP regions in the scene
+		std::vector<PxU32> broadphase_regions;
+		//objects reported outside of the broadphase regions
+		OutOfBoundsQueue out_of_bounds;
+		//state of the scene after CustomInit, used by Reset
+		SceneSnapshot snapshot;
+		//actor wrappers added to the scene
+		std::vector<Actor*> actor_wrappers;
+		//objects of a loaded scene, the collection lives in the mapped file
+		PxCollection* loaded_collection;
+		MappedFile* loaded_file;
+		std::vector<Actor*> loaded_actors;
+		//statics made of frozen actors
+		std::vector<PxRigidStatic*> frozen;
+
+		//create the PhysX scene and its dispatcher
+		void CreateScene();
+
+		//finish the initialisation once the actors are in place
+		void FinishInit();
+
+		//create a grid of MBP regions around the actors of the scene, replacing the regions set up before
+		void SetupBroadPhaseRegions();
+
+		//handle the objects reported by the broadphase during the last step
+		void HandleOutOfBounds();
 
 		void HighlightOn(PxRigidDynamic* actor);
 
 		void HighlightOff(PxRigidDynamic* actor);
 
 	public:
-		Scene(PxSimulationFilterShader custom_filter_shader=PxDefaultSimulationFilterShader) : filter_shader(custom_filter_shader) {}
+		///Use the hardware concurrency minus one as the number of worker threads
+		static const PxU32 AUTO_THREADS = 0xffffffff;
+
+		///Maximum number of actors in a single aggregate
+		static const PxU32 MAX_AGGREGATE_SIZE = 128;
+
+		///Simulation task dispatchers
+		enum DispatcherType
+		{
+			//PxDefaultCpuDispatcher owned by the scene
+			DEFAULT_DISPATCHER,
+			//the shared work-stealing job system
+			JOB_SYSTEM_DISPATCHER
+		};
+
+		Scene(PxSimulationFilterShader custom_filter_shader=PxDefaultSimulationFilterShader) 
+			: px_scene(0), delta_time(0.f), filter_shader(custom_filter_shader), num_threads(AUTO_THREADS), dispatcher_type(DEFAULT_DISPATCHER), cpu_dispatcher(0), shared_dispatcher(false),
+			simulation_complete("Scene::SimulationComplete"), use_aggregates(true), use_ccd(false),
+			broadphase_type(PxBroadPhaseType::eSAP), region_subdivisions(4), region_margin(5.f),
+			loaded_collection(0), loaded_file(0) {}
 
 		///Init the scene
 		void Init();
@@ -120,21 +312,117 @@ namespace PhysicsEngine
 		///User defined initialisation
 		virtual void CustomInit() {}
 
+		///Save the actors, joints and their shapes, materials and meshes as a binary collection (cloth is not saved)
+		void Save(const std::string& file_name);
+
+		///Init the scene from a file written by Save instead of CustomInit
+		void Load(const std::string& file_name);
+
+		///User defined initialisation of a loaded scene, the actor wrappers are already in Actors()
+		virtual void CustomLoad() {}
+
+		///User defined settling, called once the actors and the broadphase are in place and before the reset snapshot
+		virtual void CustomSettle() {}
+
+		///Simulate until all the given dynamic actors sleep (or max_steps) and return their rest poses.
+		///The scene is put back into its state before the call, returns false if the actors did not settle.
+		bool Settle(const std::vector<Actor*>& actors, std::vector<PxTransform>& poses, PxReal dt=1.f/60.f, PxU32 max_steps=1200);
+
+		///Hash of the poses, shapes and materials of all actor wrappers
+		PxU64 CourseHash();
+
+		///Move the shapes of dynamic actors at rest into a static actor (a new one if merged is 0) and return it, 0 if none of them is in the scene.
+		///The dynamics are only taken out of the scene, Reset brings them back.
+		PxRigidStatic* Freeze(const std::vector<PxRigidDynamic*>& actors, PxRigidStatic* merged=0);
+
+		///Release the statics created by Freeze
+		void ReleaseFrozen();
+
+		///Check the shapes of the given actors against the scene with batched overlap queries and
+		///return the penetrations deeper than the tolerance, a pair of the given actors is reported once
+		std::vector<Overlap> FindOverlaps(const std::vector<PxRigidActor*>& actors, PxReal tolerance=.001f);
+
 		///Perform a single simulation step
 		void Update(PxReal dt);
 
+		///Time step of the current or the last Update
+		PxReal DeltaTime();
+
 		///User defined update step
 		virtual void CustomUpdate(bool amIDone) {}
 
+		///Handle an actor that left all broadphase regions, removes it from the scene by default
+		virtual void CustomOutOfBounds(PxActor* actor);
+
+		///Handle an aggregate that left all broadphase regions, removes it from the scene by default
+		virtual void CustomOutOfBounds(PxAggregate* aggregate);
+
+		///Register a task that runs in parallel with every simulation step, released with the scene
+		StepTask* AddStepTask(const char* name, const std::function<void()>& function);
+
 		///Add actors
 		void Add(Actor* actor);
 
+		///Add several actors in a single call
+		void AddBatch(const std::vector<Actor*>& actors);
+
+		///Add actors grouped into aggregates of up to MAX_AGGREGATE_SIZE actors (no planes),
+		///the broadphase then tracks each aggregate as a single volume
+		void AddAggregate(const std::vector<Actor*>& actors, bool self_collisions=true);
+
+		///Remove actors from the scene and release them with their wrappers, aggregates left empty are released too.
+		///The reset state is cleared, take a new Snapshot once the scene is complete again.
+		void Remove(const std::vector<Actor*>& actors);
+
+		///Enable aggregates, when disabled AddAggregate adds the actors as a plain batch
+		void Aggregates(bool value);
+
+		///Check if aggregates are enabled
+		bool Aggregates();
+
+		///Enable CCD, used by the next Init. Only the actors set up with DynamicActor::SetCCD are swept.
+		void CCD(bool value);
+
+		///Check if CCD is enabled
+		bool CCD();
+
+		///Select the broadphase, used by the next Init.
+		///MBP regions are a grid of subdivisions x subdivisions cells covering the actors added by CustomInit plus the margin, set up again when a course is reloaded.
+		void BroadPhase(PxBroadPhaseType::Enum type, PxU32 subdivisions=4, PxReal margin=5.f);
+
+		///Get the selected broadphase
+		PxBroadPhaseType::Enum BroadPhase();
+
 		///Get the PxScene object
 		PxScene* Get();
 
-		///Reset the scene
+		///Reset the scene to the state captured after CustomInit, without recreating any object
 		void Reset();
 
+		///User defined reset, called after the actors have been restored
+		virtual void CustomReset() {}
+
+		///Capture the current state as the one restored by Reset
+		void Snapshot();
+
+		///Release the scene and build it again from scratch
+		void Rebuild();
+
+		///Release the PhysX scene and its dispatcher
+		void Release();
+
+		///Set the number of worker threads and their affinity masks, used by the next Init (fewer masks than threads are repeated)
+		void Threads(PxU32 value, const std::vector<PxU32>& masks=std::vector<PxU32>());
+
+		///Get the number of worker threads used by the scene
+		PxU32 Threads();
+
+		///Select the dispatcher, used by the next Init
+		void Dispatcher(DispatcherType value);
+
+		///Get the selected dispatcher
+		DispatcherType Dispatcher();
+
 		///Set pause
 		void Pause(bool value);
 
@@ -149,6 +437,12 @@ namespace PhysicsEngine
 
 		///a list with all actors
 		std::vector<PxActor*> GetAllActors();
+
+		///a list with all joints
+		std::vector<PxJoint*> GetAllJoints();
+
+		///Actor wrappers in the order they were added
+		const std::vector<Actor*>& Actors();
 	};
 
 	///Generic Joint class
@@ -160,6 +454,9 @@ namespace PhysicsEngine
 	public:
 		Joint() : joint(0) {}
 
+		///Wrap an existing joint
+		Joint(PxJoint* existing) : joint(existing) {}
+
 		PxJoint* Get() { return joint; }
 	};
 
@@ -0,0 +1,136 @@
+#include "ProjectilePool.h"
+
+namespace PhysicsEngine
+{
+	using namespace std;
+
+	vector<Actor*> ProjectilePool::Create(const ProjectilePoolDesc& _desc, PxMaterial* material, const PxVec3& color, const PxTransform& _park_pose)
+	{
+		desc = _desc;
+		park_pose = _park_pose;
+		Clear();
+
+		vector<Actor*> actors;
+		projectiles.reserve(desc.capacity);
+		for (PxU32 i = 0; i < desc.capacity; i++)
+		{
+			Sphere* sphere = new Sphere(park_pose, desc.radius, desc.density);
+			sphere->Material(material);
+			sphere->Color(color);
+			sphere->Name("Bullet");
+			sphere->SetCCD(desc.ccd);
+			sphere->Get()->setActorFlag(PxActorFlag::eDISABLE_SIMULATION, true);
+
+			Projectile projectile = { sphere, park_pose.p, 0.f, false };
+			projectiles.push_back(projectile);
+			actors.push_back(sphere);
+		}
+
+		return actors;
+	}
+
+	void ProjectilePool::Adopt(const ProjectilePoolDesc& _desc, Actor* actor)
+	{
+		desc = _desc;
+
+		//a saved pool is parked, its first sphere shows where
+		PxRigidDynamic* px_actor = (PxRigidDynamic*)actor->Get();
+		if (projectiles.empty() && (px_actor->getActorFlags() & PxActorFlag::eDISABLE_SIMULATION))
+			park_pose = px_actor->getGlobalPose();
+
+		Projectile projectile = { actor, park_pose.p, 0.f, false };
+		projectiles.push_back(projectile);
+		Park(projectiles.back());
+	}
+
+	void ProjectilePool::Clear()
+	{
+		projectiles.clear();
+		next = 0;
+		flying = 0;
+	}
+
+	void ProjectilePool::Park(Projectile& projectile)
+	{
+		PxRigidDynamic* actor = (PxRigidDynamic*)projectile.actor->Get();
+
+		//velocities cannot be changed once the simulation is disabled
+		if (!(actor->getActorFlags() & PxActorFlag::eDISABLE_SIMULATION))
+		{
+			actor->setLinearVelocity(PxVec3(0.f), false);
+			actor->setAngularVelocity(PxVec3(0.f), false);
+			actor->setActorFlag(PxActorFlag::eDISABLE_SIMULATION, true);
+		}
+		actor->setGlobalPose(park_pose, false);
+
+		if (projectile.flying)
+			flying--;
+		projectile.flying = false;
+		projectile.age = 0.f;
+	}
+
+	bool ProjectilePool::Park(PxActor* actor)
+	{
+		for (unsigned int i = 0; i < projectiles.size(); i++)
+		{
+			if (projectiles[i].actor->Get() == actor)
+			{
+				Park(projectiles[i]);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	Actor* ProjectilePool::Fire(const PxTransform& pose, const PxVec3& impulse)
+	{
+		if (projectiles.empty())
+			return 0;
+
+		Projectile& projectile = projectiles[next];
+		next = (next + 1) % projectiles.size();
+		if (projectile.flying)
+			Park(projectile);
+
+		PxRigidDynamic* actor = (PxRigidDynamic*)projectile.actor->Get();
+		actor->setActorFlag(PxActorFlag::eDISABLE_SIMULATION, false);
+		actor->setGlobalPose(pose);
+		actor->setLinearVelocity(PxVec3(0.f));
+		actor->setAngularVelocity(PxVec3(0.f));
+		//wakes the actor
+		actor->addForce(impulse, PxForceMode::eIMPULSE);
+
+		projectile.origin = pose.p;
+		projectile.age = 0.f;
+		projectile.flying = true;
+		flying++;
+
+		return projectile.actor;
+	}
+
+	void ProjectilePool::Update(PxReal dt)
+	{
+		if (!flying)
+			return;
+
+		for (unsigned int i = 0; i < projectiles.size(); i++)
+		{
+			Projectile& projectile = projectiles[i];
+			if (!projectile.flying)
+				continue;
+
+			projectile.age += dt;
+			PxVec3 position = ((PxRigidDynamic*)projectile.actor->Get())->getGlobalPose().p;
+			if ((projectile.age > desc.lifetime) || (position.y < desc.min_height) ||
+				((position - projectile.origin).magnitudeSquared() > desc.range * desc.range))
+				Park(projectile);
+		}
+	}
+
+	void ProjectilePool::Reset()
+	{
+		for (unsigned int i = 0; i < projectiles.size(); i++)
+			Park(projectiles[i]);
+		next = 0;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "BasicActors.h"
+#include <vector>
+
+namespace PhysicsEngine
+{
+	///Settings of a projectile pool
+	struct ProjectilePoolDesc
+	{
+		//spheres created up front, firing never creates more
+		PxU32 capacity;
+		PxReal radius;
+		PxReal density;
+		//seconds in flight before a projectile is parked again
+		PxReal lifetime;
+		//a projectile is parked again once it is further than range from where it was fired or below min_height
+		PxReal range;
+		PxReal min_height;
+		//sweep the spheres with CCD, in a scene with CCD enabled
+		bool ccd;
+
+		ProjectilePoolDesc() : capacity(40), radius(.013f), density(1.f), lifetime(10.f), range(50.f), min_height(-1.f), ccd(true) {}
+	};
+
+	///Fixed set of sphere projectiles sharing one material.
+	///The spheres stay in the scene and are parked out of the simulation (PxActorFlag::eDISABLE_SIMULATION) until fired,
+	///firing re-poses and wakes a parked sphere, or the oldest one in flight when all of them are in use.
+	class ProjectilePool
+	{
+		struct Projectile
+		{
+			Actor* actor;
+			//where it was fired from and for how long it has been in flight
+			PxVec3 origin;
+			PxReal age;
+			bool flying;
+		};
+
+		ProjectilePoolDesc desc;
+		std::vector<Projectile> projectiles;
+		//the projectiles are fired round robin, so the next one is also the oldest
+		PxU32 next;
+		PxU32 flying;
+		PxTransform park_pose;
+
+		void Park(Projectile& projectile);
+
+	public:
+		ProjectilePool() : next(0), flying(0), park_pose(PxIdentity) {}
+
+		///Create the spheres parked at _park_pose, the actors still have to be added to the scene
+		std::vector<Actor*> Create(const ProjectilePoolDesc& _desc, PxMaterial* material, const PxVec3& color, const PxTransform& _park_pose);
+
+		///Take over a sphere of a loaded scene and park it
+		void Adopt(const ProjectilePoolDesc& _desc, Actor* actor);
+
+		///Forget all projectiles, their actors belong to the scene
+		void Clear();
+
+		///Fire a projectile from pose with an impulse, returns its actor or 0 if the pool is empty
+		Actor* Fire(const PxTransform& pose, const PxVec3& impulse);
+
+		///Age the projectiles in flight by dt and park the spent ones
+		void Update(PxReal dt);
+
+		///Park the projectile of an actor, false if the actor is not part of the pool
+		bool Park(PxActor* actor);
+
+		///Start over with every projectile parked, e.g. after the scene has been restored
+		void Reset();
+
+		///Number of spheres in the pool
+		PxU32 Capacity() const { return (PxU32)projectiles.size(); }
+
+		///Number of spheres in flight
+		PxU32 Flying() const { return flying; }
+	};
+}
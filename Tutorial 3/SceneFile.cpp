@@ -0,0 +1,192 @@
+#include "SceneFile.h"
+#include "Exception.h"
+#include <fstream>
+#include <cstring>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace PhysicsEngine
+{
+	using namespace std;
+
+	static const char scene_file_magic[8] = { 'P', 'X', 'S', 'C', 'E', 'N', 'E', 0 };
+
+	template<class T>
+	static void Write(ofstream& file, const T& value)
+	{
+		file.write((const char*)&value, sizeof(T));
+	}
+
+	void WriteSceneFile(const string& file_name, const void* collection, PxU32 collection_size, const vector<SceneFileActor>& actors)
+	{
+		ofstream file(file_name.c_str(), ios::binary);
+		if (!file)
+			throw new Exception("PhysicsEngine::WriteSceneFile, could not create the file.");
+
+		SceneFileHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, scene_file_magic, sizeof(header.magic));
+		header.version = SceneFileHeader::VERSION;
+		header.physx_version = PX_PHYSICS_VERSION;
+		header.collection_size = collection_size;
+		header.table_offset = SceneFileHeader::COLLECTION_OFFSET + collection_size;
+
+		//header padded up to the collection
+		vector<char> padding(SceneFileHeader::COLLECTION_OFFSET - sizeof(header), 0);
+		Write(file, header);
+		file.write(padding.data(), padding.size());
+		file.write((const char*)collection, collection_size);
+
+		streampos table_start = file.tellp();
+		Write(file, (PxU32)actors.size());
+		for (unsigned int i = 0; i < actors.size(); i++)
+		{
+			Write(file, actors[i].id);
+			Write(file, (PxU32)actors[i].name.size());
+			file.write(actors[i].name.data(), actors[i].name.size());
+			Write(file, (PxU32)actors[i].colors.size());
+			if (actors[i].colors.size())
+				file.write((const char*)actors[i].colors.data(), actors[i].colors.size() * sizeof(PxVec3));
+		}
+
+		header.table_size = (PxU64)(file.tellp() - table_start);
+		file.seekp(0);
+		Write(file, header);
+
+		if (!file)
+			throw new Exception("PhysicsEngine::WriteSceneFile, could not write the file.");
+	}
+
+	MappedFile::MappedFile()
+		: data(0), size(0),
+#ifdef _WIN32
+		file(INVALID_HANDLE_VALUE), mapping(0)
+#else
+		buffer(0)
+#endif
+	{
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(const string& file_name)
+	{
+		Close();
+
+#ifdef _WIN32
+		file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || !file_size.QuadPart)
+		{
+			Close();
+			return false;
+		}
+
+		//copy-on-write: deserialisation patches the pointers in place
+		mapping = CreateFileMappingA(file, 0, PAGE_WRITECOPY, 0, 0, 0);
+		if (mapping)
+			data = (PxU8*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+
+		if (!data)
+		{
+			Close();
+			return false;
+		}
+
+		size = (size_t)file_size.QuadPart;
+#else
+		ifstream input(file_name.c_str(), ios::binary | ios::ate);
+		if (!input)
+			return false;
+
+		size = (size_t)input.tellg();
+		//no mapping here: read into a block with the same alignment
+		buffer = new PxU8[size + SceneFileHeader::COLLECTION_OFFSET];
+		data = (PxU8*)(((size_t)buffer + SceneFileHeader::COLLECTION_OFFSET - 1) & ~(size_t)(SceneFileHeader::COLLECTION_OFFSET - 1));
+		input.seekg(0);
+		input.read((char*)data, size);
+		if (!input)
+		{
+			Close();
+			return false;
+		}
+#endif
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = 0;
+		file = INVALID_HANDLE_VALUE;
+#else
+		delete[] buffer;
+		buffer = 0;
+#endif
+		data = 0;
+		size = 0;
+	}
+
+	const SceneFileHeader& ReadSceneFile(MappedFile& file, vector<SceneFileActor>& actors)
+	{
+		if (file.Size() < SceneFileHeader::COLLECTION_OFFSET)
+			throw new Exception("PhysicsEngine::ReadSceneFile, not a scene file.");
+
+		const SceneFileHeader& header = *(const SceneFileHeader*)file.Data();
+		if (memcmp(header.magic, scene_file_magic, sizeof(header.magic)) || (header.version != SceneFileHeader::VERSION))
+			throw new Exception("PhysicsEngine::ReadSceneFile, not a scene file.");
+		if (header.physx_version != PX_PHYSICS_VERSION)
+			throw new Exception("PhysicsEngine::ReadSceneFile, the file was saved by a different PhysX version.");
+		if ((header.table_offset + header.table_size > file.Size()) || (SceneFileHeader::COLLECTION_OFFSET + header.collection_size > header.table_offset))
+			throw new Exception("PhysicsEngine::ReadSceneFile, the file is truncated.");
+
+		const PxU8* read = file.Data() + header.table_offset;
+		const PxU8* end = read + header.table_size;
+
+		//bounds checked read of the side table
+		auto Read = [&read, end](void* value, size_t bytes)
+		{
+			if ((size_t)(end - read) < bytes)
+				throw new Exception("PhysicsEngine::ReadSceneFile, the side table is corrupted.");
+			memcpy(value, read, bytes);
+			read += bytes;
+		};
+
+		PxU32 count;
+		Read(&count, sizeof(count));
+		//an entry takes at least its id and two lengths
+		if (count > header.table_size / (sizeof(PxSerialObjectId) + 2 * sizeof(PxU32)))
+			throw new Exception("PhysicsEngine::ReadSceneFile, the side table is corrupted.");
+		actors.resize(count);
+
+		for (PxU32 i = 0; i < count; i++)
+		{
+			PxU32 length;
+			Read(&actors[i].id, sizeof(actors[i].id));
+			Read(&length, sizeof(length));
+			actors[i].name.resize(length);
+			if (length)
+				Read(&actors[i].name[0], length);
+			Read(&length, sizeof(length));
+			actors[i].colors.resize(length);
+			if (length)
+				Read(actors[i].colors.data(), length * sizeof(PxVec3));
+		}
+
+		return header;
+	}
+}
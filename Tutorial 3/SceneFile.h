@@ -0,0 +1,68 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+#include <string>
+#include <vector>
+
+namespace PhysicsEngine
+{
+	using namespace physx;
+
+	///Layout of a saved scene: the header, the binary PhysX collection at COLLECTION_OFFSET
+	///and a side table with the names and colours of the actor wrappers
+	struct SceneFileHeader
+	{
+		//binary collections have to be 128-byte aligned in memory
+		static const PxU32 COLLECTION_OFFSET = 128;
+		static const PxU32 VERSION = 1;
+
+		char magic[8];
+		PxU32 version;
+		PxU32 physx_version;
+		PxU64 collection_size;
+		PxU64 table_offset;
+		PxU64 table_size;
+	};
+
+	///Side table entry of an actor wrapper
+	struct SceneFileActor
+	{
+		PxSerialObjectId id;
+		std::string name;
+		std::vector<PxVec3> colors;
+	};
+
+	///Write a scene file
+	void WriteSceneFile(const std::string& file_name, const void* collection, PxU32 collection_size, const std::vector<SceneFileActor>& actors);
+
+	///Read-only file mapped into memory with copy-on-write pages, the base address is page aligned
+	class MappedFile
+	{
+		PxU8* data;
+		size_t size;
+#ifdef _WIN32
+		void* file;
+		void* mapping;
+#else
+		PxU8* buffer;
+#endif
+
+	public:
+		MappedFile();
+
+		~MappedFile();
+
+		///Map the file, false if it cannot be opened
+		bool Open(const std::string& file_name);
+
+		///Unmap the file
+		void Close();
+
+		PxU8* Data() { return data; }
+
+		size_t Size() const { return size; }
+	};
+
+	///Check the header of a mapped scene file and read its side table, throws if the file is not valid
+	const SceneFileHeader& ReadSceneFile(MappedFile& file, std::vector<SceneFileActor>& actors);
+}
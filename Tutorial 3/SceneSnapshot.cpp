@@ -0,0 +1,215 @@
+#include "SceneSnapshot.h"
+#include <algorithm>
+
+namespace PhysicsEngine
+{
+	using namespace std;
+
+	static vector<PxActor*> SceneActors(PxScene* scene)
+	{
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+		PxActorTypeSelectionFlags selection_flag = PxActorTypeSelectionFlag::eRIGID_DYNAMIC | PxActorTypeSelectionFlag::eRIGID_STATIC |
+			PxActorTypeSelectionFlag::eCLOTH;
+#else
+		PxActorTypeFlags selection_flag = PxActorTypeFlag::eRIGID_DYNAMIC | PxActorTypeFlag::eRIGID_STATIC |
+			PxActorTypeFlag::eCLOTH;
+#endif
+		vector<PxActor*> actors(scene->getNbActors(selection_flag));
+		if (actors.size())
+			scene->getActors(selection_flag, actors.data(), (PxU32)actors.size());
+		return actors;
+	}
+
+	void SceneSnapshot::Capture(PxScene* scene)
+	{
+		Clear();
+
+		vector<PxActor*> scene_actors = SceneActors(scene);
+		actors.reserve(scene_actors.size());
+
+		for (unsigned int i = 0; i < scene_actors.size(); i++)
+		{
+			PxActor* actor = scene_actors[i];
+			members.insert(actor);
+
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			if (actor->isCloth())
+#else
+			if (actor->is<PxCloth>())
+#endif
+			{
+				PxCloth* cloth = (PxCloth*)actor;
+				ClothState state;
+				state.cloth = cloth;
+				state.pose = cloth->getGlobalPose();
+				state.particles.resize(cloth->getNbParticles());
+
+				PxClothParticleData* particle_data = cloth->lockParticleData();
+				if (particle_data)
+				{
+					for (PxU32 j = 0; j < state.particles.size(); j++)
+						state.particles[j] = particle_data->particles[j];
+					particle_data->unlock();
+				}
+
+				cloths.push_back(state);
+				continue;
+			}
+
+			ActorState state;
+			state.actor = actor;
+			state.aggregate = actor->getAggregate();
+			state.actor_flags = actor->getActorFlags();
+			state.pose = ((PxRigidActor*)actor)->getGlobalPose();
+			state.sleeping = false;
+			state.wake_counter = 0.f;
+
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			if (actor->isRigidDynamic())
+#else
+			if (actor->is<PxRigidDynamic>())
+#endif
+			{
+				PxRigidDynamic* dynamic = (PxRigidDynamic*)actor;
+				state.body_flags = dynamic->getRigidBodyFlags();
+				state.linear_velocity = dynamic->getLinearVelocity();
+				state.angular_velocity = dynamic->getAngularVelocity();
+				state.sleeping = dynamic->isSleeping();
+				state.wake_counter = dynamic->getWakeCounter();
+			}
+
+			actors.push_back(state);
+
+			if (state.aggregate && (std::find(aggregates.begin(), aggregates.end(), state.aggregate) == aggregates.end()))
+				aggregates.push_back(state.aggregate);
+		}
+
+		vector<PxConstraint*> constraints(scene->getNbConstraints());
+		if (constraints.size())
+			scene->getConstraints(constraints.data(), (PxU32)constraints.size());
+
+		for (unsigned int i = 0; i < constraints.size(); i++)
+		{
+			PxU32 type_id;
+			void* external = constraints[i]->getExternalReference(type_id);
+			if (type_id != PxConstraintExtIDs::eJOINT)
+				continue;
+
+			JointState state;
+			state.joint = (PxJoint*)external;
+			state.flags = state.joint->getConstraintFlags();
+			state.drive_velocity = 0.f;
+			state.drive_force_limit = 0.f;
+
+			if (state.joint->getConcreteType() == PxJointConcreteType::eREVOLUTE)
+			{
+				PxRevoluteJoint* revolute = (PxRevoluteJoint*)state.joint;
+				state.revolute_flags = revolute->getRevoluteJointFlags();
+				state.drive_velocity = revolute->getDriveVelocity();
+				state.drive_force_limit = revolute->getDriveForceLimit();
+			}
+
+			joints.push_back(state);
+		}
+	}
+
+	void SceneSnapshot::Restore(PxScene* scene)
+	{
+		//take out what has been added since the capture
+		vector<PxActor*> scene_actors = SceneActors(scene);
+		for (unsigned int i = 0; i < scene_actors.size(); i++)
+		{
+			if (!Contains(scene_actors[i]))
+				scene->removeActor(*scene_actors[i]);
+		}
+
+		//bring back what has been removed
+		for (unsigned int i = 0; i < aggregates.size(); i++)
+		{
+			if (!aggregates[i]->getScene())
+				scene->addAggregate(*aggregates[i]);
+		}
+
+		for (unsigned int i = 0; i < actors.size(); i++)
+		{
+			ActorState& state = actors[i];
+			PxActor* actor = state.actor;
+
+			if (!actor->getScene())
+			{
+				//an aggregate in a scene adds its new actors to the scene as well
+				if (state.aggregate && !actor->getAggregate())
+					state.aggregate->addActor(*actor);
+				else if (!state.aggregate)
+					scene->addActor(*actor);
+			}
+
+			actor->setActorFlags(state.actor_flags);
+
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			if (actor->isRigidDynamic())
+#else
+			if (actor->is<PxRigidDynamic>())
+#endif
+			{
+				PxRigidDynamic* dynamic = (PxRigidDynamic*)actor;
+				dynamic->setRigidBodyFlags(state.body_flags);
+				dynamic->setGlobalPose(state.pose, false);
+
+				//kinematics and disabled actors keep no velocity or sleep state
+				if (!(state.body_flags & PxRigidBodyFlag::eKINEMATIC) && !(state.actor_flags & PxActorFlag::eDISABLE_SIMULATION))
+				{
+					dynamic->setLinearVelocity(state.linear_velocity, false);
+					dynamic->setAngularVelocity(state.angular_velocity, false);
+					if (state.sleeping)
+						dynamic->putToSleep();
+					else
+						dynamic->setWakeCounter(state.wake_counter);
+				}
+			}
+			else
+			{
+				((PxRigidActor*)actor)->setGlobalPose(state.pose, false);
+			}
+		}
+
+		for (unsigned int i = 0; i < cloths.size(); i++)
+		{
+			ClothState& state = cloths[i];
+			if (!state.cloth->getScene())
+				scene->addActor(*state.cloth);
+
+			state.cloth->setGlobalPose(state.pose);
+			//no motion: the previous positions equal the current ones
+			state.cloth->setParticles(state.particles.data(), state.particles.data());
+		}
+
+		for (unsigned int i = 0; i < joints.size(); i++)
+		{
+			JointState& state = joints[i];
+			state.joint->setConstraintFlags(state.flags);
+
+			if (state.joint->getConcreteType() == PxJointConcreteType::eREVOLUTE)
+			{
+				PxRevoluteJoint* revolute = (PxRevoluteJoint*)state.joint;
+				revolute->setRevoluteJointFlags(state.revolute_flags);
+				revolute->setDriveVelocity(state.drive_velocity);
+				revolute->setDriveForceLimit(state.drive_force_limit);
+			}
+		}
+	}
+
+	void SceneSnapshot::Clear()
+	{
+		actors.clear();
+		cloths.clear();
+		joints.clear();
+		aggregates.clear();
+		members.clear();
+	}
+
+	bool SceneSnapshot::Contains(const PxActor* actor) const
+	{
+		return members.find(actor) != members.end();
+	}
+}
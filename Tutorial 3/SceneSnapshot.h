@@ -0,0 +1,68 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+#include <vector>
+#include <unordered_set>
+
+namespace PhysicsEngine
+{
+	using namespace physx;
+
+	///State of all actors and joints of a scene, restored in place without recreating any object.
+	///Actors added after the capture are removed from the scene on restore (but not released).
+	class SceneSnapshot
+	{
+		struct ActorState
+		{
+			PxActor* actor;
+			PxAggregate* aggregate;
+			PxActorFlags actor_flags;
+			PxTransform pose;
+			//rigid dynamics only
+			PxRigidBodyFlags body_flags;
+			PxVec3 linear_velocity;
+			PxVec3 angular_velocity;
+			bool sleeping;
+			PxReal wake_counter;
+		};
+
+		struct ClothState
+		{
+			PxCloth* cloth;
+			PxTransform pose;
+			std::vector<PxClothParticle> particles;
+		};
+
+		struct JointState
+		{
+			PxJoint* joint;
+			PxConstraintFlags flags;
+			//revolute joints only
+			PxRevoluteJointFlags revolute_flags;
+			PxReal drive_velocity;
+			PxReal drive_force_limit;
+		};
+
+		std::vector<ActorState> actors;
+		std::vector<ClothState> cloths;
+		std::vector<JointState> joints;
+		std::vector<PxAggregate*> aggregates;
+		std::unordered_set<const PxActor*> members;
+
+	public:
+		///Record the current state of the scene
+		void Capture(PxScene* scene);
+
+		///Put the scene back into the recorded state, O(actors)
+		void Restore(PxScene* scene);
+
+		///Check if a state has been recorded
+		bool Empty() const { return actors.empty(); }
+
+		///Forget the recorded state
+		void Clear();
+
+		///Check if the actor was part of the recorded scene
+		bool Contains(const PxActor* actor) const;
+	};
+}
@@ -0,0 +1,68 @@
+#include "SettleCache.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace PhysicsEngine
+{
+	using namespace std;
+
+	static string settle_directory = "settle_cache";
+
+	static string SettleFile(PxU64 course_hash)
+	{
+		stringstream name;
+		name << settle_directory << "/" << hex << setw(16) << setfill('0') << course_hash << ".settle";
+		return name.str();
+	}
+
+	bool LoadSettledPoses(PxU64 course_hash, vector<PxTransform>& poses)
+	{
+		if (settle_directory.empty())
+			return false;
+
+		ifstream file(SettleFile(course_hash).c_str(), ios::binary);
+		if (!file)
+			return false;
+
+		PxU32 count = 0;
+		file.read((char*)&count, sizeof(count));
+		if (!file || (count != poses.size()))
+			return false;
+
+		file.read((char*)poses.data(), count * sizeof(PxTransform));
+		return (bool)file;
+	}
+
+	void SaveSettledPoses(PxU64 course_hash, const vector<PxTransform>& poses)
+	{
+		if (settle_directory.empty())
+			return;
+
+#ifdef _WIN32
+		_mkdir(settle_directory.c_str());
+#else
+		mkdir(settle_directory.c_str(), 0755);
+#endif
+		//a failed write only means settling again next time
+		ofstream file(SettleFile(course_hash).c_str(), ios::binary);
+		PxU32 count = (PxU32)poses.size();
+		file.write((const char*)&count, sizeof(count));
+		file.write((const char*)poses.data(), count * sizeof(PxTransform));
+	}
+
+	void SettleCacheDirectory(const string& directory)
+	{
+		settle_directory = directory;
+	}
+
+	const string& SettleCacheDirectory()
+	{
+		return settle_directory;
+	}
+}
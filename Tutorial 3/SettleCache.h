@@ -0,0 +1,22 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+#include <string>
+#include <vector>
+
+namespace PhysicsEngine
+{
+	using namespace physx;
+
+	///Read the rest poses stored for a course into poses (sized to the number of actors), false if there are none
+	bool LoadSettledPoses(PxU64 course_hash, std::vector<PxTransform>& poses);
+
+	///Store the rest poses of a course
+	void SaveSettledPoses(PxU64 course_hash, const std::vector<PxTransform>& poses);
+
+	///Set the directory of the rest poses, an empty name turns the cache off
+	void SettleCacheDirectory(const std::string& directory);
+
+	///Get the directory of the rest poses
+	const std::string& SettleCacheDirectory();
+}
@@ -0,0 +1,180 @@
+#include "SimulationThread.h"
+#include <chrono>
+
+namespace VisualDebugger
+{
+	using namespace physx;
+	using namespace std;
+
+	typedef chrono::steady_clock Clock;
+
+	//do not try to catch up more than this many steps after a stall
+	static const int MAX_CATCH_UP_STEPS = 5;
+
+	SimulationThread::SimulationThread(PhysicsEngine::MyScene* _scene, PxReal _delta_time)
+		: scene(_scene), delta_time(_delta_time), running(false), steps(0)
+	{
+	}
+
+	SimulationThread::~SimulationThread()
+	{
+		Stop();
+	}
+
+	void SimulationThread::Start()
+	{
+		if (running)
+			return;
+
+		running = true;
+		thread = std::thread(&SimulationThread::Main, this);
+	}
+
+	void SimulationThread::Stop()
+	{
+		running = false;
+		if (thread.joinable())
+			thread.join();
+
+		//commands posted after the last step still have to happen
+		RunCommands();
+	}
+
+	bool SimulationThread::Running()
+	{
+		return running;
+	}
+
+	void SimulationThread::Post(const function<void()>& command)
+	{
+		lock_guard<mutex> guard(command_lock);
+		commands.push_back(command);
+	}
+
+	const PoseFrame& SimulationThread::Frame()
+	{
+		return poses.Read();
+	}
+
+	void SimulationThread::Main()
+	{
+		Clock::duration step = chrono::duration_cast<Clock::duration>(chrono::duration<double>(delta_time));
+		Clock::time_point next = Clock::now();
+
+		while (running)
+		{
+			RunCommands();
+
+			scene->Update(delta_time);
+
+			Capture(poses.WriteFrame());
+			poses.Publish();
+
+			//fixed step: sleep until the next tick, or drop the backlog if the simulation fell too far behind
+			next += step;
+			Clock::time_point now = Clock::now();
+			if (now > next + step * MAX_CATCH_UP_STEPS)
+				next = now;
+			this_thread::sleep_until(next);
+		}
+	}
+
+	void SimulationThread::RunCommands()
+	{
+		{
+			lock_guard<mutex> guard(command_lock);
+			pending.swap(commands);
+		}
+
+		for (unsigned int i = 0; i < pending.size(); i++)
+			pending[i]();
+		pending.clear();
+	}
+
+	void SimulationThread::Capture(PoseFrame& frame)
+	{
+		frame.shapes.clear();
+		frame.step = ++steps;
+		frame.paused = scene->Pause();
+		frame.done = scene->dominoesDone();
+		frame.status = scene->WaveText();
+
+		std::vector<PxActor*> actors = scene->GetAllActors();
+
+		unsigned int cloth_count = 0;
+		unsigned int particles_count = 0;
+		for (unsigned int i = 0; i < actors.size(); i++)
+		{
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			if (actors[i]->isCloth())
+#else
+			if (actors[i]->is<PxCloth>())
+#endif
+			{
+				PxCloth* cloth = (PxCloth*)actors[i];
+				UserData* data = (UserData*)cloth->userData;
+
+				if (frame.cloths.size() <= cloth_count)
+					frame.cloths.resize(cloth_count + 1);
+				ClothPose& cloth_pose = frame.cloths[cloth_count++];
+
+				cloth_pose.pose = cloth->getGlobalPose();
+				cloth_pose.color = *data->color;
+				cloth_pose.mesh_desc = data->cloth_mesh_desc;
+				cloth_pose.verts.resize(cloth->getNbParticles());
+
+				PxClothParticleData* particle_data = cloth->lockParticleData();
+				if (particle_data)
+				{
+					for (PxU32 j = 0; j < cloth_pose.verts.size(); j++)
+						cloth_pose.verts[j] = particle_data->particles[j].pos;
+					particle_data->unlock();
+				}
+			}
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			else if (actors[i]->isParticleSystem())
+#else
+			else if (actors[i]->is<PxParticleSystem>())
+#endif
+			{
+				PxParticleSystem* particles = (PxParticleSystem*)actors[i];
+				UserData* data = (UserData*)particles->userData;
+
+				if (frame.particles.size() <= particles_count)
+					frame.particles.resize(particles_count + 1);
+				ParticlesPose& particles_pose = frame.particles[particles_count++];
+
+				particles_pose.color = (data && data->color) ? *data->color : PhysicsEngine::default_color;
+				ParticlePositions(particles, particles_pose.positions);
+			}
+#if PX_PHYSICS_VERSION < 0x304000 // SDK 3.3
+			else if (actors[i]->isRigidActor())
+#else
+			else if (actors[i]->is<PxRigidActor>())
+#endif
+			{
+				//parked actors are hidden
+				if (actors[i]->getActorFlags() & PxActorFlag::eDISABLE_SIMULATION)
+					continue;
+
+				PxRigidActor* rigid_actor = (PxRigidActor*)actors[i];
+				PxU32 nb_shapes = rigid_actor->getNbShapes();
+				for (PxU32 j = 0; j < nb_shapes; j++)
+				{
+					PxShape* shape;
+					rigid_actor->getShapes(&shape, 1, j);
+
+					ShapePose shape_pose;
+					shape_pose.geometry = shape->getGeometry();
+					shape_pose.pose = PxShapeExt::getGlobalPose(*shape, *rigid_actor);
+					PxVec3* color = ShapeColor(shape, rigid_actor);
+					shape_pose.color = color ? *color : PhysicsEngine::default_color;
+					frame.shapes.push_back(shape_pose);
+				}
+			}
+		}
+
+		frame.cloths.resize(cloth_count);
+		frame.particles.resize(particles_count);
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "MyPhysicsEngine.h"
+#include "Extras\PoseBuffer.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+namespace VisualDebugger
+{
+	using namespace physx;
+
+	///Steps a scene at a fixed rate on a dedicated thread.
+	///Actor poses are published through a triple buffer, so the renderer never touches the PhysX scene,
+	///and user input reaches the scene as commands executed between two steps.
+	class SimulationThread
+	{
+		PhysicsEngine::MyScene* scene;
+		PxReal delta_time;
+		PoseBuffer poses;
+		std::thread thread;
+		std::atomic<bool> running;
+		PxU32 steps;
+		std::mutex command_lock;
+		std::vector<std::function<void()>> commands;
+		std::vector<std::function<void()>> pending;
+
+		void Main();
+
+		void RunCommands();
+
+		void Capture(PoseFrame& frame);
+
+	public:
+		SimulationThread(PhysicsEngine::MyScene* _scene, PxReal _delta_time);
+
+		~SimulationThread();
+
+		///Start stepping the scene
+		void Start();
+
+		///Stop after the current step and wait for the thread to finish
+		void Stop();
+
+		///Is the simulation thread running
+		bool Running();
+
+		///Queue a command to run on the simulation thread before the next step
+		void Post(const std::function<void()>& command);
+
+		///Latest published frame
+		const PoseFrame& Frame();
+	};
+}
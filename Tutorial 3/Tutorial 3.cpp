@@ -3,11 +3,37 @@
 
 using namespace std;
 
-int main()
+int main(int argc, char* argv[])
 {
+	//Tutorial 3 [course file] [--settle] [--activation <off|sleep|kinematic>] [--freeze]
+	string course_file;
+	VisualDebugger::Options options;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--settle")
+			options.settle = true;
+		else if (arg == "--activation" && (i + 1 < argc))
+		{
+			string mode = argv[++i];
+			if (mode == "off")
+				options.activation = PhysicsEngine::MyScene::ACTIVATION_OFF;
+			else if (mode == "sleep")
+				options.activation = PhysicsEngine::MyScene::ACTIVATION_SLEEP;
+			else if (mode == "kinematic")
+				options.activation = PhysicsEngine::MyScene::ACTIVATION_KINEMATIC;
+			else
+				cerr << "Unknown activation mode " << mode << ", using off" << endl;
+		}
+		else if (arg == "--freeze")
+			options.freeze = true;
+		else
+			course_file = arg;
+	}
+
 	try 
 	{ 
-		VisualDebugger::Init("Tutorial 3", 800, 800); 
+		VisualDebugger::Init("Tutorial 3", 800, 800, course_file, options); 
 	}
 	catch (Exception exc) 
 	{ 
@@ -1,5 +1,10 @@
 #include "VisualDebugger.h"
 #include <vector>
+#include <functional>
+#include <atomic>
+#include <iostream>
+#include <sys/stat.h>
+#include "SimulationThread.h"
 #include "Extras\Camera.h"
 #include "Extras\Renderer.h"
 #include "Extras\HUD.h"
@@ -35,7 +40,9 @@ namespace VisualDebugger
 
 	void RenderScene();
 	void ToggleRenderMode();
+	void ToggleSimulationThread();
 	void HUDInit();
+	time_t FileTime(const std::string& file_name);
 
 	///simulation objects
 	Camera* camera;
@@ -47,13 +54,27 @@ namespace VisualDebugger
 	bool key_state[MAX_KEYS];
 	bool hud_show = true;
 	HUD hud;
+	SimulationThread* sim_thread;
+	//course file watched for changes and its last modification time
+	std::string watched_course;
+	time_t watched_time = 0;
+	int watch_frames = 0;
+	//set by the scene commands that may rebuild the scene, the renderer drops its heightfields
+	std::atomic<bool> scene_rebuilt(false);
 
 	//Init the debugger
-	void Init(const char *window_name, int width, int height)
+	void Init(const char *window_name, int width, int height, const std::string& course_file, const Options& options)
 	{
 		///Init PhysX
 		PhysicsEngine::PxInit();
 		scene = new PhysicsEngine::MyScene();
+		scene->Course(course_file);
+		watched_course = course_file;
+		//taken before the file is read, an edit saved while the course is built is picked up by the first check
+		watched_time = course_file.size() ? FileTime(course_file) : 0;
+		scene->SettleCourse(options.settle);
+		scene->Activation(options.activation);
+		scene->FreezeDominoes(options.freeze);
 		scene->Init();
 
 		///Init renderer
@@ -64,6 +85,8 @@ namespace VisualDebugger
 
 		camera = new Camera(PxVec3(0.0f, 5.0f, 15.0f), PxVec3(0.f,-.1f,-1.f), 5.f);
 
+		sim_thread = new SimulationThread(scene, delta_time);
+
 		//initialise HUD
 		HUDInit();
 
@@ -96,6 +119,7 @@ namespace VisualDebugger
 		hud.AddLine(HELP, " Simulation");
 		hud.AddLine(HELP, "    F9 - select next actor");
 		hud.AddLine(HELP, "    F10 - pause");
+		hud.AddLine(HELP, "    F11 - simulation thread on/off");
 		hud.AddLine(HELP, "    F12 - reset");
 		hud.AddLine(HELP, "");
 		hud.AddLine(HELP, " Display");
@@ -116,6 +140,7 @@ namespace VisualDebugger
 		hud.AddLine(HELP, "");
 		hud.AddLine(HELP, " Fire Sphere (fired forwards from camera)");
 		hud.AddLine(HELP, "    SPACE");
+		hud.AddLine(HELP, "    P - rigid spheres/particles (1024 at a time)");
 		//add a pause screen
 		hud.AddLine(PAUSE, "");
 		hud.AddLine(PAUSE, "");
@@ -137,31 +162,111 @@ namespace VisualDebugger
 		glutMainLoop(); 
 	}
 
+	//Run a command on the scene: queued for the simulation thread if it is running, straight away otherwise
+	void SceneCommand(const std::function<void()>& command)
+	{
+		if (sim_thread->Running())
+			sim_thread->Post(command);
+		else
+			command();
+	}
+
+	//Modification time of a file, 0 if it cannot be read
+	time_t FileTime(const std::string& file_name)
+	{
+#ifdef _WIN32
+		struct _stat info;
+		return _stat(file_name.c_str(), &info) ? 0 : info.st_mtime;
+#else
+		struct stat info;
+		return stat(file_name.c_str(), &info) ? 0 : info.st_mtime;
+#endif
+	}
+
+	//Apply the changes of the course file to the live course, the file is checked every 30 frames
+	void WatchCourse()
+	{
+		if (watched_course.empty() || (++watch_frames % 30))
+			return;
+
+		time_t time = FileTime(watched_course);
+		if (!time || (time == watched_time))
+			return;
+		watched_time = time;
+
+		SceneCommand([]()
+		{
+			//a broken edit leaves the live course as it is
+			try
+			{
+				PxU32 segments = scene->ReloadCourse();
+				scene_rebuilt = true;
+				std::cout << "VisualDebugger, course reloaded, " << segments << " segment(s) spawned" << std::endl;
+			}
+			catch (Exception* exc)
+			{
+				std::cerr << exc->what() << std::endl;
+				delete exc;
+			}
+		});
+	}
+
+	//Delete the cached heightfields of a rebuilt scene, checked after the frame is taken so a frame of the new scene never meets them
+	void ReleaseRenderCache()
+	{
+		if (scene_rebuilt.exchange(false))
+			Renderer::ReleaseHeightFields();
+	}
+
 	//Render the scene and perform a single simulation step
 	void RenderScene()
 	{
 		//handle pressed keys
 		KeyHold();
 
+		WatchCourse();
+
 		//start rendering
 		Renderer::Start(camera->getEye(), camera->getDir());
 
-		if ((render_mode == DEBUG) || (render_mode == BOTH))
+		bool paused, done;
+		std::string status;
+
+		if (sim_thread->Running())
 		{
-			Renderer::Render(scene->Get()->getRenderBuffer());
+			//the simulation thread owns the scene, draw its latest published poses
+			//(debug visualisation is only available in the synchronous mode)
+			const PoseFrame& frame = sim_thread->Frame();
+			ReleaseRenderCache();
+			if ((render_mode == NORMAL) || (render_mode == BOTH))
+				Renderer::Render(frame);
+			paused = frame.paused;
+			done = frame.done;
+			status = frame.status;
 		}
-
-		if ((render_mode == NORMAL) || (render_mode == BOTH))
+		else
 		{
-			std::vector<PxActor*> actors = scene->GetAllActors();
-			if (actors.size())
-				Renderer::Render(&actors[0], (PxU32)actors.size());
+			ReleaseRenderCache();
+			if ((render_mode == DEBUG) || (render_mode == BOTH))
+			{
+				Renderer::Render(scene->Get()->getRenderBuffer());
+			}
+
+			if ((render_mode == NORMAL) || (render_mode == BOTH))
+			{
+				std::vector<PxActor*> actors = scene->GetAllActors();
+				if (actors.size())
+					Renderer::Render(&actors[0], (PxU32)actors.size());
+			}
+			paused = scene->Pause();
+			done = scene->dominoesDone();
+			status = scene->WaveText();
 		}
 
 		//adjust the HUD state
 		if (hud_show)
 		{
-			if (scene->Pause())
+			if (paused)
 				hud.ActiveScreen(PAUSE);
 			else
 				hud.ActiveScreen(HELP);
@@ -169,7 +274,7 @@ namespace VisualDebugger
 		else
 			hud.ActiveScreen(EMPTY);
 		//perform a single simulation step
-		if (scene->dominoesDone()) {
+		if (done) {
 			hud.ActiveScreen(SDONE);
 			//set font size for all screens
 			hud.FontSize(0.168f);
@@ -178,12 +283,14 @@ namespace VisualDebugger
 		}
 		//render HUD
 		hud.Render();
+		if (hud_show)
+			Renderer::RenderText(status, PxVec2(0.f, 0.02f), PxVec3(0.f, 0.f, 0.f), 0.018f);
 
 		//finish rendering
 		Renderer::Finish();
 
-		
-		scene->Update(delta_time);
+		if (!sim_thread->Running())
+			scene->Update(delta_time);
 	}
 
 	//user defined keyboard handlers
@@ -193,11 +300,18 @@ namespace VisualDebugger
 		{
 		//implement your own
 		case 'H':
-			scene->HammerPress();
+			SceneCommand([]() { scene->HammerPress(); });
 			break;
 
 		case ' ':
-			scene->Fire(camera->getTransform());
+		{
+			PxTransform camera_pose = camera->getTransform();
+			SceneCommand([camera_pose]() { scene->Fire(camera_pose); });
+			break;
+		}
+		case 'P':
+			SceneCommand([]() { scene->Marbles((scene->Marbles() == PhysicsEngine::MyScene::MARBLES_RIGID) ?
+				PhysicsEngine::MyScene::MARBLES_PARTICLES : PhysicsEngine::MyScene::MARBLES_RIGID); });
 			break;
 		default:
 			break;
@@ -210,7 +324,7 @@ namespace VisualDebugger
 		{
 		//implement your own
 		case 'H':
-			scene->HammerRelease();
+			SceneCommand([]() { scene->HammerRelease(); });
 			break;
 		default:
 			break;
@@ -252,33 +366,42 @@ namespace VisualDebugger
 	//handle force control keys
 	void ForceInput(int key)
 	{
-		if (!scene->GetSelectedActor())
-			return;
+		PxVec3 direction;
 
 		switch (toupper(key))
 		{
 			// Force controls on the selected actor
 		case 'I': //forward
-			scene->GetSelectedActor()->addForce(PxVec3(0,0,-1)*gForceStrength);
+			direction = PxVec3(0,0,-1);
 			break;
 		case 'K': //backward
-			scene->GetSelectedActor()->addForce(PxVec3(0,0,1)*gForceStrength);
+			direction = PxVec3(0,0,1);
 			break;
 		case 'J': //left
-			scene->GetSelectedActor()->addForce(PxVec3(-1,0,0)*gForceStrength);
+			direction = PxVec3(-1,0,0);
 			break;
 		case 'L': //right
-			scene->GetSelectedActor()->addForce(PxVec3(1,0,0)*gForceStrength);
+			direction = PxVec3(1,0,0);
 			break;
 		case 'U': //up
-			scene->GetSelectedActor()->addForce(PxVec3(0,1,0)*gForceStrength);
+			direction = PxVec3(0,1,0);
 			break;
 		case 'M': //down
-			scene->GetSelectedActor()->addForce(PxVec3(0,-1,0)*gForceStrength);
+			direction = PxVec3(0,-1,0);
 			break;
 		default:
-			break;
+			return;
 		}
+
+		PxVec3 force = direction*gForceStrength;
+		SceneCommand([force]()
+		{
+			//a parked domino stays kinematic until the wave gets close and a parked marble is out of the simulation,
+			//forces cannot move either of them
+			PxRigidDynamic* actor = scene->GetSelectedActor();
+			if (actor && !actor->getRigidBodyFlags().isSet(PxRigidBodyFlag::eKINEMATIC) && !(actor->getActorFlags() & PxActorFlag::eDISABLE_SIMULATION))
+				actor->addForce(force);
+		});
 	}
 
 	///handle special keys
@@ -308,15 +431,20 @@ namespace VisualDebugger
 			//simulation control
 		case GLUT_KEY_F9:
 			//select next actor
-			scene->SelectNextActor();
+			SceneCommand([]() { scene->SelectNextActor(); });
 			break;
 		case GLUT_KEY_F10:
 			//toggle scene pause
-			scene->Pause(!scene->Pause());
+			SceneCommand([]() { scene->Pause(!scene->Pause()); });
+			break;
+		case GLUT_KEY_F11:
+			//toggle the simulation thread
+			ToggleSimulationThread();
 			break;
 		case GLUT_KEY_F12:
 			//resect scene
-			scene->Reset();
+			//without a snapshot the reset rebuilds the scene
+			SceneCommand([]() { scene->Reset(); scene_rebuilt = true; });
 			break;
 		default:
 			break;
@@ -391,10 +519,20 @@ namespace VisualDebugger
 			render_mode = NORMAL;
 	}
 
+	void ToggleSimulationThread()
+	{
+		if (sim_thread->Running())
+			sim_thread->Stop();
+		else
+			sim_thread->Start();
+	}
+
 	///exit callback
 	void exitCallback(void)
 	{
+		delete sim_thread;
 		delete camera;
+		scene->Release();
 		delete scene;
 		PhysicsEngine::PxRelease();
 	}
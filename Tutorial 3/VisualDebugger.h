@@ -6,8 +6,21 @@ namespace VisualDebugger
 {
 	using namespace physx;
 
-	///Init visualisation
-	void Init(const char *window_name, int width=512, int height=512);
+	///Start options of the course, the baseline behaviour by default
+	struct Options
+	{
+		//start with the dominoes asleep at their rest poses, a course not settled before blocks the start
+		bool settle;
+		//park the dominoes ahead of the topple wave
+		PhysicsEngine::MyScene::ActivationMode activation;
+		//merge the toppled dominoes at rest into statics, they can no longer be selected or pushed
+		bool freeze;
+
+		Options() : settle(false), activation(PhysicsEngine::MyScene::ACTIVATION_OFF), freeze(false) {}
+	};
+
+	///Init visualisation, the course is read from course_file (the built-in one if empty) and reloaded when the file changes
+	void Init(const char *window_name, int width=512, int height=512, const std::string& course_file="", const Options& options=Options());
 
 	///Start visualisation
 	void Start();